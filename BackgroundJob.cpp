@@ -0,0 +1,45 @@
+#include "BackgroundJob.h"
+
+#include <exception>
+
+BackgroundJob::BackgroundJob(const Work& work, QObject* parent)
+    : QThread(parent)
+    , m_work(work)
+    , m_succeeded(false)
+    , m_cancelled(false)
+{
+}
+
+Progress& BackgroundJob::progress()
+{
+    return m_progress;
+}
+
+bool BackgroundJob::succeeded() const
+{
+    return m_succeeded;
+}
+
+bool BackgroundJob::wasCancelled() const
+{
+    return m_cancelled;
+}
+
+const QString& BackgroundJob::error() const
+{
+    return m_error;
+}
+
+void BackgroundJob::run()
+{
+    try {
+        m_work(m_progress);
+        m_succeeded = true;
+    } catch (const Cancelled& ) {
+        m_cancelled = true;
+    } catch (const std::exception& e) {
+        m_error = QString::fromStdString(e.what());
+    } catch (...) {
+        m_error = "Unknown error";
+    }
+}
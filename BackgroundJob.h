@@ -0,0 +1,40 @@
+#ifndef BACKGROUNDJOB_H
+#define BACKGROUNDJOB_H
+
+#include "Progress.h"
+
+#include <QString>
+#include <QThread>
+
+#include <functional>
+
+// Runs a function on its own thread, reporting to a progress which the GUI
+// thread polls and may cancel. The function must not touch widgets; its
+// results are picked up once the thread has finished.
+class BackgroundJob
+    : public QThread
+{
+public:
+    typedef std::function<void (Progress& )> Work;
+
+    BackgroundJob(const Work& work, QObject* parent = 0);
+
+    Progress& progress();
+
+    // Valid after finished
+    bool succeeded() const;
+    bool wasCancelled() const;
+    const QString& error() const;
+
+protected:
+    virtual void run();
+
+private:
+    Work m_work;
+    Progress m_progress;
+    bool m_succeeded;
+    bool m_cancelled;
+    QString m_error;
+};
+
+#endif // BACKGROUNDJOB_H
@@ -0,0 +1,103 @@
+#include "FloorplanArena.h"
+
+#include <cassert>
+
+FloorplanArena::FloorplanArena()
+{
+}
+
+FloorplanArena::FloorplanArena(const FloorplanArena& other)
+    : m_leaves(other.m_leaves)
+    , m_floorplans(other.m_floorplans)
+{
+}
+
+FloorplanArena::~FloorplanArena()
+{
+}
+
+FloorplanArena::Index FloorplanArena::createLeaf(Module* module)
+{
+    assert(m_leaves.size() < leafBit);
+    return static_cast<Index>(m_leaves.append(LeafFloorplan(module))) | leafBit;
+}
+
+FloorplanArena::Index FloorplanArena::createFloorplan(Index left, Index right, Floorplan::Type type)
+{
+    assert(m_floorplans.size() < leafBit);
+    Index index = static_cast<Index>(m_floorplans.append(Floorplan(*this, left, right, type)));
+    node(left)->parent = index;
+    node(right)->parent = index;
+    return index;
+}
+
+FloorplanArena::Index FloorplanArena::reserveFloorplans(std::size_t count)
+{
+    assert(m_floorplans.size() + count < leafBit);
+    Index first = static_cast<Index>(m_floorplans.size());
+    m_floorplans.extend(count, Floorplan());
+    return first;
+}
+
+void FloorplanArena::createFloorplanAt(Index index, Index left, Index right, Floorplan::Type type)
+{
+    assert(!isLeafIndex(index) && index < m_floorplans.size());
+    *m_floorplans.at(index) = Floorplan(*this, left, right, type);
+    node(left)->parent = index;
+    node(right)->parent = index;
+}
+
+void FloorplanArena::reorderFloorplans(const std::vector<Index>& order)
+{
+    assert(order.size() == m_floorplans.size());
+    std::vector<Index> position(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        position[order[i]] = static_cast<Index>(i);
+    }
+
+    // Read through a const pool, the old chunks are not changed
+    const Pool<Floorplan>& old = m_floorplans;
+    Pool<Floorplan> floorplans;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        Floorplan f = *old.at(order[i]);
+        if (!isLeafIndex(f.left)) {
+            f.left = position[f.left];
+        }
+        if (!isLeafIndex(f.right)) {
+            f.right = position[f.right];
+        }
+        if (f.parent != null) {
+            f.parent = position[f.parent];
+        }
+        floorplans.append(f);
+    }
+    for (std::size_t i = 0; i < m_leaves.size(); ++i) {
+        LeafFloorplan* leaf = m_leaves.at(i);
+        if (leaf->parent != null) {
+            leaf->parent = position[leaf->parent];
+        }
+    }
+    m_floorplans.swap(floorplans);
+}
+
+void FloorplanArena::detach()
+{
+    m_leaves.detach();
+    m_floorplans.detach();
+}
+
+std::size_t FloorplanArena::leafCount() const
+{
+    return m_leaves.size();
+}
+
+std::size_t FloorplanArena::floorplanCount() const
+{
+    return m_floorplans.size();
+}
+
+void FloorplanArena::clear()
+{
+    m_leaves.clear();
+    m_floorplans.clear();
+}
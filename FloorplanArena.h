@@ -0,0 +1,282 @@
+#ifndef FLOORPLAN_ARENA_H
+#define FLOORPLAN_ARENA_H
+
+#include "Floorplans.h"
+#include "Profiler.h"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Owns all nodes of a slicing tree.
+// Leaves and internal nodes live in two chunked pools, so nodes are stored
+// contiguously, never move once created and are all released at once.
+// Nodes are addressed by 32-bit indices; the highest bit of an index tells
+// which pool the node belongs to.
+//
+// Chunks are copy-on-write: a copy of an arena shares all chunks with the
+// original and takes time proportional to the number of chunks only. The
+// non-const accessors copy the chunk of a node before handing out a
+// pointer to it, so a shared chunk is copied once by the first change to
+// any of its nodes, and the other arena keeps the old nodes. Pointers
+// returned by the const accessors may refer to shared chunks and must not
+// be kept across changes to the arena.
+class FloorplanArena
+{
+public:
+    typedef BaseFloorplan::Index Index;
+
+    static constexpr Index null = 0xffffffffu;
+
+    FloorplanArena();
+    FloorplanArena(const FloorplanArena& other); // shares the nodes of other
+    ~FloorplanArena();
+
+    Index createLeaf(Module* module);
+
+    // Also links both children to the new floorplan as their parent
+    Index createFloorplan(Index left, Index right, Floorplan::Type type);
+
+    // Appends count empty floorplans and returns the index of the first one.
+    // The slots are filled later with createFloorplanAt, which allows
+    // several threads to build disjoint parts of a tree at the same time.
+    Index reserveFloorplans(std::size_t count);
+    void createFloorplanAt(Index index, Index left, Index right, Floorplan::Type type);
+
+    const BaseFloorplan* node(Index index) const;
+    const LeafFloorplan* leaf(Index index) const;
+    const Floorplan* floorplan(Index index) const;
+
+    const BaseFloorplan* left(const Floorplan* f) const;
+    const BaseFloorplan* right(const Floorplan* f) const;
+
+    // Copy the chunk of the node if it is shared with another arena
+    BaseFloorplan* node(Index index);
+    LeafFloorplan* leaf(Index index);
+    Floorplan* floorplan(Index index);
+
+    BaseFloorplan* left(const Floorplan* f);
+    BaseFloorplan* right(const Floorplan* f);
+
+    // Copies every shared chunk at once. Changing nodes through the
+    // non-const accessors is only safe from several threads after this.
+    void detach();
+
+    static bool isLeafIndex(Index index);
+
+    // Moves floorplan order[i] to index i and updates all links. order
+    // must list every floorplan once.
+    void reorderFloorplans(const std::vector<Index>& order);
+
+    std::size_t leafCount() const;
+    std::size_t floorplanCount() const;
+
+    void clear();
+
+    static constexpr Index leafBit = 0x80000000u;
+
+private:
+    FloorplanArena& operator = (const FloorplanArena& );
+
+    template<typename T>
+    class Pool
+    {
+    public:
+        static const std::size_t chunkBits = 10;
+        static const std::size_t chunkSize = std::size_t(1) << chunkBits;
+
+        Pool()
+            : m_size(0)
+        {
+        }
+
+        // Shares all chunks with other, see FloorplanArena(const FloorplanArena& )
+        Pool(const Pool& other)
+            : m_chunks(other.m_chunks)
+            , m_size(other.m_size)
+        {
+        }
+
+        const T* at(std::size_t i) const
+        {
+            return m_chunks[i >> chunkBits]->items() + (i & (chunkSize - 1));
+        }
+
+        T* at(std::size_t i)
+        {
+            return ownChunk(i >> chunkBits)->items() + (i & (chunkSize - 1));
+        }
+
+        std::size_t append(const T& value)
+        {
+            if ((m_size >> chunkBits) == m_chunks.size()) {
+                m_chunks.push_back(std::make_shared<Chunk>());
+                Profiler::count(Profiler::Allocations);
+            }
+            ownChunk(m_size >> chunkBits)->append(value);
+            return m_size++;
+        }
+
+        void extend(std::size_t count, const T& value)
+        {
+            for (std::size_t i = 0; i < count; ++i) {
+                append(value);
+            }
+        }
+
+        std::size_t size() const
+        {
+            return m_size;
+        }
+
+        void swap(Pool& other)
+        {
+            m_chunks.swap(other.m_chunks);
+            std::swap(m_size, other.m_size);
+        }
+
+        void detach()
+        {
+            for (std::size_t i = 0; i < m_chunks.size(); ++i) {
+                ownChunk(i);
+            }
+        }
+
+        void clear()
+        {
+            m_chunks.clear();
+            m_size = 0;
+        }
+
+    private:
+        Pool& operator = (const Pool& );
+
+        class Chunk
+        {
+        public:
+            Chunk()
+                : m_count(0)
+            {
+            }
+
+            Chunk(const Chunk& other)
+                : m_count(0)
+            {
+                for (std::size_t i = 0; i < other.m_count; ++i) {
+                    append(other.items()[i]);
+                }
+            }
+
+            ~Chunk()
+            {
+                for (std::size_t i = 0; i < m_count; ++i) {
+                    items()[i].~T();
+                }
+            }
+
+            T* items()
+            {
+                return reinterpret_cast<T*>(m_storage);
+            }
+
+            const T* items() const
+            {
+                return reinterpret_cast<const T*>(m_storage);
+            }
+
+            void append(const T& value)
+            {
+                new (items() + m_count) T(value);
+                ++m_count;
+            }
+
+        private:
+            Chunk& operator = (const Chunk& );
+
+            std::size_t m_count;
+            alignas(T) unsigned char m_storage[sizeof(T) * chunkSize];
+        };
+
+        // Copies the chunk first if another pool shares it
+        Chunk* ownChunk(std::size_t c)
+        {
+            std::shared_ptr<Chunk>& chunk = m_chunks[c];
+            if (chunk.use_count() != 1) {
+                chunk = std::make_shared<Chunk>(*chunk);
+                Profiler::count(Profiler::Allocations);
+            }
+            return chunk.get();
+        }
+
+        std::vector<std::shared_ptr<Chunk> > m_chunks;
+        std::size_t m_size;
+    };
+
+    Pool<LeafFloorplan> m_leaves;
+    Pool<Floorplan> m_floorplans;
+};
+
+inline const BaseFloorplan* FloorplanArena::node(Index index) const
+{
+    if (index & leafBit) {
+        return m_leaves.at(index & ~leafBit);
+    }
+    return m_floorplans.at(index);
+}
+
+inline const LeafFloorplan* FloorplanArena::leaf(Index index) const
+{
+    return isLeafIndex(index) ? m_leaves.at(index & ~leafBit) : 0;
+}
+
+inline const Floorplan* FloorplanArena::floorplan(Index index) const
+{
+    return isLeafIndex(index) ? 0 : m_floorplans.at(index);
+}
+
+inline const BaseFloorplan* FloorplanArena::left(const Floorplan* f) const
+{
+    return node(f->left);
+}
+
+inline const BaseFloorplan* FloorplanArena::right(const Floorplan* f) const
+{
+    return node(f->right);
+}
+
+inline BaseFloorplan* FloorplanArena::node(Index index)
+{
+    if (index & leafBit) {
+        return m_leaves.at(index & ~leafBit);
+    }
+    return m_floorplans.at(index);
+}
+
+inline LeafFloorplan* FloorplanArena::leaf(Index index)
+{
+    return isLeafIndex(index) ? m_leaves.at(index & ~leafBit) : 0;
+}
+
+inline Floorplan* FloorplanArena::floorplan(Index index)
+{
+    return isLeafIndex(index) ? 0 : m_floorplans.at(index);
+}
+
+inline BaseFloorplan* FloorplanArena::left(const Floorplan* f)
+{
+    return node(f->left);
+}
+
+inline BaseFloorplan* FloorplanArena::right(const Floorplan* f)
+{
+    return node(f->right);
+}
+
+inline bool FloorplanArena::isLeafIndex(Index index)
+{
+    return (index & leafBit) != 0;
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "FloorplanGenerator.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Part of the outline which still holds count blocks
+struct Region
+{
+    std::int64_t x;
+    std::int64_t y;
+    std::int64_t width;
+    std::int64_t height;
+    std::size_t count;
+    std::size_t depth;
+};
+
+std::size_t ceilLog2(std::size_t n)
+{
+    std::size_t result = 0;
+    while ((std::size_t(1) << result) < n) {
+        ++result;
+    }
+    return result;
+}
+
+// Returns a position in [low, high] close to preferred whose cut line is
+// not used yet, or -1 if all of them are taken. Cut lines at distinct
+// coordinates keep junctions from lining up across a parent cut, where
+// SlicingTreeBuilder would merge blocks of different subtrees.
+std::int64_t freeCut(std::vector<bool>& used, std::int64_t low, std::int64_t high, std::int64_t preferred)
+{
+    if (low > high) {
+        return -1;
+    }
+    preferred = std::min(std::max(preferred, low), high);
+    for (std::int64_t d = 0; preferred - d >= low || preferred + d <= high; ++d) {
+        if (preferred + d <= high && !used[preferred + d]) {
+            used[preferred + d] = true;
+            return preferred + d;
+        }
+        if (preferred - d >= low && !used[preferred - d]) {
+            used[preferred - d] = true;
+            return preferred - d;
+        }
+    }
+    return -1;
+}
+
+// Cuts the side of a region starting at origin between two parts of first
+// and second blocks, in proportion to their counts and leaving each part at
+// least one unit per block across the given breadth. Returns the length
+// of the first part, or 0 if no cut line is left.
+std::int64_t splitLength(std::vector<bool>& used, std::int64_t origin, std::int64_t length, std::int64_t breadth,
+                         std::size_t first, std::size_t second)
+{
+    const std::int64_t minFirst = (static_cast<std::int64_t>(first) + breadth - 1) / breadth;
+    const std::int64_t minSecond = (static_cast<std::int64_t>(second) + breadth - 1) / breadth;
+    const double share = static_cast<double>(first) / static_cast<double>(first + second);
+    const std::int64_t proportional = static_cast<std::int64_t>(std::llround(length * share));
+    const std::int64_t cut = freeCut(used, origin + minFirst, origin + length - minSecond, origin + proportional);
+    return cut < 0 ? 0 : cut - origin;
+}
+
+char* appendNumber(char* p, char* end, std::uint64_t value)
+{
+    return std::to_chars(p, end, value).ptr;
+}
+
+}
+
+GeneratorOptions::GeneratorOptions()
+    : blockCount(1000)
+    , seed(1)
+    , maxAspectRatio(2)
+    , skew(0.2)
+    , maxDepth(0)
+    , netCount(1)
+    , netSize(2)
+{
+}
+
+void generateFloorplan(std::ostream& out, const GeneratorOptions& options)
+{
+    const std::size_t blockCount = std::max<std::size_t>(options.blockCount, 1);
+    const double skew = std::min(std::max(options.skew, 0.0), 0.999);
+    const double maxAspectRatio = std::max(options.maxAspectRatio, 1.0);
+    std::mt19937_64 random(options.seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    // Square outline with about 1024 x 1024 units per block, and at least
+    // a few times as many units along each side as there are cuts
+    const std::int64_t side = std::max<std::int64_t>(
+        1024 * static_cast<std::int64_t>(std::ceil(std::sqrt(static_cast<double>(blockCount)))),
+        16 * static_cast<std::int64_t>(blockCount));
+    std::vector<bool> usedX(side + 1);
+    std::vector<bool> usedY(side + 1);
+    std::vector<std::int64_t> blocks;
+    blocks.reserve(4 * blockCount);
+
+    // Explicit stack, as skewed cuts make the tree very deep
+    Region outline = {0, 0, side, side, blockCount, 0};
+    std::vector<Region> stack(1, outline);
+    while (!stack.empty()) {
+        Region region = stack.back();
+        stack.pop_back();
+        if (region.count == 1) {
+            blocks.push_back(region.x);
+            blocks.push_back(region.y);
+            blocks.push_back(region.width);
+            blocks.push_back(region.height);
+            continue;
+        }
+
+        // Blocks of the first part: a random share between half and a
+        // single block, depending on skew, unless the depth limit is near
+        std::size_t first = region.count / 2;
+        const bool depthLeft = options.maxDepth == 0 || region.depth + ceilLog2(region.count) < options.maxDepth;
+        if (depthLeft) {
+            const double share = 0.5 - skew * 0.5 * unit(random);
+            first = static_cast<std::size_t>(std::llround(region.count * share));
+            first = std::min(std::max<std::size_t>(first, 1), region.count - 1);
+            if (unit(random) < 0.5) {
+                first = region.count - first;
+            }
+        }
+        const std::size_t second = region.count - first;
+
+        // Cut across the long side of elongated regions, else at random
+        bool vertical = unit(random) < 0.5;
+        if (region.width > maxAspectRatio * region.height) {
+            vertical = true;
+        } else if (region.height > maxAspectRatio * region.width) {
+            vertical = false;
+        }
+        std::int64_t length = 0;
+        if (vertical) {
+            length = splitLength(usedX, region.x, region.width, region.height, first, second);
+        }
+        if (length == 0) {
+            vertical = false;
+            length = splitLength(usedY, region.y, region.height, region.width, first, second);
+        }
+        if (length == 0) {
+            vertical = true;
+            length = splitLength(usedX, region.x, region.width, region.height, first, second);
+        }
+        if (length == 0) {
+            throw std::runtime_error("Cannot split the floorplan into that many blocks");
+        }
+
+        Region a = region;
+        Region b = region;
+        a.count = first;
+        b.count = second;
+        a.depth = b.depth = region.depth + 1;
+        if (vertical) {
+            a.width = length;
+            b.x += length;
+            b.width -= length;
+        } else {
+            a.height = length;
+            b.y += length;
+            b.height -= length;
+        }
+        stack.push_back(b);
+        stack.push_back(a);
+    }
+
+    // Pins sorted by block, so that every line lists its nets in order
+    std::vector<std::pair<std::uint64_t, std::uint64_t> > pins;
+    const std::size_t netSize = std::min(options.netSize, blockCount);
+    pins.reserve(options.netCount * netSize);
+    std::uniform_int_distribution<std::uint64_t> anyBlock(0, blockCount - 1);
+    std::vector<std::uint64_t> members;
+    for (std::size_t net = 0; net < options.netCount; ++net) {
+        // Draw until netSize distinct blocks are left
+        members.clear();
+        while (members.size() < netSize) {
+            while (members.size() < netSize) {
+                members.push_back(anyBlock(random));
+            }
+            std::sort(members.begin(), members.end());
+            members.erase(std::unique(members.begin(), members.end()), members.end());
+        }
+        for (std::size_t i = 0; i < members.size(); ++i) {
+            pins.push_back(std::make_pair(members[i], static_cast<std::uint64_t>(net)));
+        }
+    }
+    std::sort(pins.begin(), pins.end());
+
+    const std::size_t bufferSize = 1 << 20;
+    std::vector<char> buffer(bufferSize);
+    char* const begin = buffer.data();
+    char* const end = begin + bufferSize;
+    char* p = begin;
+    std::size_t pin = 0;
+    for (std::size_t i = 0; i < blockCount; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            if (j > 0) {
+                *p++ = ' ';
+            }
+            p = appendNumber(p, end, static_cast<std::uint64_t>(blocks[4 * i + j]));
+        }
+        for (; pin < pins.size() && pins[pin].first == i; ++pin) {
+            *p++ = ' ';
+            if (options.netCount == 1) {
+                *p++ = '+';
+            } else {
+                p = appendNumber(p, end, pins[pin].second);
+            }
+            if (end - p < 64) {
+                out.write(begin, p - begin);
+                p = begin;
+            }
+        }
+        *p++ = '\n';
+        if (end - p < 256) {
+            out.write(begin, p - begin);
+            p = begin;
+        }
+    }
+    out.write(begin, p - begin);
+}
+
+void generateFloorplan(std::string fileName, const GeneratorOptions& options)
+{
+    std::ofstream outFile(fileName.c_str());
+    if (outFile.fail()) {
+        throw std::runtime_error("Cannot write to file " + fileName);
+    }
+    generateFloorplan(outFile, options);
+    outFile.close();
+    if (outFile.fail()) {
+        throw std::runtime_error("Cannot write to file " + fileName);
+    }
+}
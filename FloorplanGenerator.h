@@ -0,0 +1,43 @@
+#ifndef FLOORPLAN_GENERATOR_H
+#define FLOORPLAN_GENERATOR_H
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+// Random guillotine floorplans in the format read by readDesign, for
+// benchmarks and tests of large designs. The outline is cut recursively
+// into integral rectangles, so the blocks always form a slicing floorplan.
+// No two cuts share a coordinate, as SlicingTreeBuilder cannot tell apart
+// the subtrees of cuts which meet at a cross.
+struct GeneratorOptions
+{
+    GeneratorOptions();
+
+    std::size_t blockCount;
+    unsigned seed;
+
+    // Rectangles longer than this relative to their width are cut across
+    // their long side; below it the direction of the cut is random
+    double maxAspectRatio;
+
+    // 0 splits the blocks of a rectangle evenly between both parts, values
+    // towards 1 cut off ever smaller parts, up to single blocks, which
+    // makes long chains of cuts
+    double skew;
+
+    // Depth of the tree of cuts; deeper parts are split evenly once the
+    // limit would be exceeded. 0 for no limit.
+    std::size_t maxDepth;
+
+    // Nets of netSize random blocks each. A single net is marked with "+",
+    // several nets are listed by their ids.
+    std::size_t netCount;
+    std::size_t netSize;
+};
+
+// Throw std::runtime_error if the file cannot be written
+void generateFloorplan(std::ostream& out, const GeneratorOptions& options);
+void generateFloorplan(std::string fileName, const GeneratorOptions& options);
+
+#endif
@@ -1,41 +1,51 @@
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <vector>
 
 #include "Floorplans.h"
+#include "FloorplanArena.h"
+#include "Profiler.h"
 
-BaseFloorplan::BaseFloorplan(const Rectangle& r, const Point& c, double w)
+BaseFloorplan::BaseFloorplan(const Rectangle& r, const Point& c, double w, Kind k)
     : rect(r)    
     , centerOfGravity(c)
     , weight(w)
+    , kind(k)
+    , parent(FloorplanArena::null)
 {
 }
 
-BaseFloorplan::BaseFloorplan()
-{
-}
-
-BaseFloorplan::~BaseFloorplan()
+BaseFloorplan::BaseFloorplan(Kind k)
+    : kind(k)
+    , parent(FloorplanArena::null)
 {
 }
 
 LeafFloorplan::LeafFloorplan(Module* m)
-    : BaseFloorplan(m->rect, Point::undefined, 0)
+    : BaseFloorplan(m->rect, Point::undefined, 0, BaseFloorplan::LEAF)
     , module(m)
 {
 }
 
-LeafFloorplan::~LeafFloorplan()
+Floorplan::Floorplan()
+    : BaseFloorplan(BaseFloorplan::HORIZONTAL)
+    , left(FloorplanArena::null)
+    , right(FloorplanArena::null)
+    , type(Floorplan::H)
+    , swap(false)
 {
 }
 
-Floorplan::Floorplan(BaseFloorplan* l, BaseFloorplan* r, Floorplan::Type t)
-    : BaseFloorplan()
-    , left(l)
-    , right(r)
+Floorplan::Floorplan(const FloorplanArena& arena, Index li, Index ri, Floorplan::Type t)
+    : BaseFloorplan(t == Floorplan::H ? BaseFloorplan::HORIZONTAL : BaseFloorplan::VERTICAL)
+    , left(li)
+    , right(ri)
     , type(t)
     , swap(false)
 {
+	const BaseFloorplan* l = arena.node(li);
+	const BaseFloorplan* r = arena.node(ri);
 	if (t == Floorplan::H) {
 		assert(l->rect.width() == r->rect.width());
 		rect = Rectangle(l->rect.x(), l->rect.y(), l->rect.width(), l->rect.height() + r->rect.height());    
@@ -46,12 +56,10 @@ Floorplan::Floorplan(BaseFloorplan* l, BaseFloorplan* r, Floorplan::Type t)
 	centerOfGravity = Point::undefined;
 }
 
-Floorplan::~Floorplan()
-{
-}
-
-Rectangle Floorplan::mergedRect() const
+Rectangle Floorplan::mergedRect(const FloorplanArena& arena) const
 {
+    const BaseFloorplan* left = arena.node(this->left);
+    const BaseFloorplan* right = arena.node(this->right);
     if (type == Floorplan::H) {
         assert(left->rect.width() == right->rect.width());
         return Rectangle(left->rect.x(), left->rect.y(), left->rect.width(), left->rect.height() + right->rect.height());
@@ -61,8 +69,10 @@ Rectangle Floorplan::mergedRect() const
     }
 }
 
-Point Floorplan::mergedCenterOfGravity() const
+Point Floorplan::mergedCenterOfGravity(const FloorplanArena& arena) const
 {
+    const BaseFloorplan* left = arena.node(this->left);
+    const BaseFloorplan* right = arena.node(this->right);
     Point p1 = left->centerOfGravity;
     Point p2 = right->centerOfGravity;
     double length = sqrt(pow(p1.x - p2.x, 2) + pow(p1.y - p2.y, 2));
@@ -78,74 +88,56 @@ Point Floorplan::mergedCenterOfGravity() const
     return Point(x, y);
 }
 
-void Floorplan::swapChildren()
+void Floorplan::swapChildren(FloorplanArena& /* arena */)
 {
-    // Swap pointers
-    BaseFloorplan* tmp = left;
+    // Swap indices
+    Index tmp = left;
     left = right;
     right = tmp;
 
-    // Fix coordinates
-    swapCoordinates();
+    // Coordinates of both subtrees are fixed later
+    swap = true;
+    Profiler::count(Profiler::SwapsApplied);
 }
 
-void Floorplan::swapCoordinates()
+void Floorplan::recalculateTree(FloorplanArena& arena)
 {
-    // Shift rects and centers of swapped children
-    if (type == Floorplan::V) {
-        // Vertically splitted floorplans should have the same y coord.
-        assert(left->rect.y() == right->rect.y());
-
-        // Shift rects
-        left->rect.setX(left->rect.x() - right->rect.width());
-        right->rect.setX(right->rect.x() + left->rect.width());
-
-        // Shift centers
-        left->centerOfGravity.shiftX(-right->rect.width());
-        right->centerOfGravity.shiftX(left->rect.width());
-    } else {
-        // Horizontally splitted floorplans should have the same x coord.
-        assert(left->rect.x() == right->rect.x());
-
-        // Shift rects
-        left->rect.setY(left->rect.y() - right->rect.height());
-        right->rect.setY(right->rect.y() + left->rect.height());
-
-        // Shift centers
-        left->centerOfGravity.shiftY(-right->rect.height());
-        right->centerOfGravity.shiftY(left->rect.height());
-    }
-}
-
-void Floorplan::recalculateTree()
-{
-	_recalculateTree(this);
-}
-
-void Floorplan::_recalculateTree(BaseFloorplan* root)
-{
-	Floorplan* f = dynamic_cast<Floorplan*>(root);
-	if (0 != f) {
-		f->left->rect.setX(f->rect.x());
-		f->left->rect.setY(f->rect.y());
+	ScopedTimer timer("recalculate tree");
+	std::uint64_t visited = 0;
+
+	// Explicit stack, as chains of cuts may make the tree very deep
+	std::vector<Floorplan*> stack(1, this);
+	while (!stack.empty()) {
+		Floorplan* f = stack.back();
+		stack.pop_back();
+		++visited;
+		f->swap = false;
+		BaseFloorplan* left = arena.node(f->left);
+		BaseFloorplan* right = arena.node(f->right);
+		left->rect.setX(f->rect.x());
+		left->rect.setY(f->rect.y());
 		if (f->type == Floorplan::V) {
-			f->right->rect.setX(f->rect.x() + f->left->rect.width());
-			f->right->rect.setY(f->rect.y());
+			right->rect.setX(f->rect.x() + left->rect.width());
+			right->rect.setY(f->rect.y());
 		} else {
-			f->right->rect.setX(f->rect.x());
-			f->right->rect.setY(f->rect.y() + f->left->rect.height());
+			right->rect.setX(f->rect.x());
+			right->rect.setY(f->rect.y() + left->rect.height());
+		}
+		if (!right->isLeaf()) {
+			stack.push_back(right->asFloorplan());
+		}
+		if (!left->isLeaf()) {
+			stack.push_back(left->asFloorplan());
 		}
-		_recalculateTree(f->left);
-		_recalculateTree(f->right);
-	} else {
-		LeafFloorplan* leaf;
-		leaf = dynamic_cast<LeafFloorplan*>(root);
-		assert(leaf);
 	}
+	Profiler::count(Profiler::NodesVisited, visited);
 }
 
-void Floorplan::recalculateChildrenCoords()
+void Floorplan::recalculateChildrenCoords(FloorplanArena& arena)
 {
+    BaseFloorplan* left = arena.node(this->left);
+    BaseFloorplan* right = arena.node(this->right);
+
     // Calculate gravity centers relative to top left corner point
     // This is needed for fixing centers after fixing coords
     const Point leftCenterRel(left->centerOfGravity.x - left->rect.x(),
@@ -153,6 +145,9 @@ void Floorplan::recalculateChildrenCoords()
     const Point rightCenterRel(right->centerOfGravity.x - right->rect.x(),
                         right->centerOfGravity.y -right->rect.y());
 
+    const Point leftOrigin(left->rect.x(), left->rect.y());
+    const Point rightOrigin(right->rect.x(), right->rect.y());
+
     // Coords of left child always match with coords of parent
     left->rect.setX(rect.x());
     left->rect.setY(rect.y());
@@ -165,6 +160,13 @@ void Floorplan::recalculateChildrenCoords()
         right->rect.setX(rect.x());
         right->rect.setY(rect.y() + left->rect.height());
     }
+    swap = false;
+    if (!left->isLeaf() && !(Point(left->rect.x(), left->rect.y()) == leftOrigin)) {
+        left->asFloorplan()->swap = true;
+    }
+    if (!right->isLeaf() && !(Point(right->rect.x(), right->rect.y()) == rightOrigin)) {
+        right->asFloorplan()->swap = true;
+    }
 
     // fix centers of gravity using relative coords
     if (!left->centerOfGravity.isNull()) {
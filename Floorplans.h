@@ -4,15 +4,41 @@
 #include "Module.h"
 #include "Geometry.h"
 
+#include <cstdint>
+
+class FloorplanArena;
+struct LeafFloorplan;
+struct Floorplan;
+
 struct BaseFloorplan
 {
+    // Nodes are referenced by their index in the owning FloorplanArena
+    typedef std::uint32_t Index;
+
+    // Tells leaves from horizontally and vertically splitted floorplans,
+    // so that traversals can dispatch without RTTI
+    enum Kind {
+        LEAF,
+        HORIZONTAL,
+        VERTICAL
+    };
+
     Rectangle rect;
     Point centerOfGravity;
     double weight;
+    Kind kind;
+    Index parent;   // FloorplanArena::null for the root
 
-    BaseFloorplan();
-    BaseFloorplan(const Rectangle& r, const Point& c, double w);
-    virtual ~BaseFloorplan();
+    BaseFloorplan(Kind k = LEAF);
+    BaseFloorplan(const Rectangle& r, const Point& c, double w, Kind k = LEAF);
+
+    bool isLeaf() const;
+
+    // Return 0 if the node is of the other kind
+    LeafFloorplan* asLeaf();
+    const LeafFloorplan* asLeaf() const;
+    Floorplan* asFloorplan();
+    const Floorplan* asFloorplan() const;
 };
 
 struct LeafFloorplan
@@ -21,7 +47,6 @@ struct LeafFloorplan
     Module* module;
 
     LeafFloorplan(Module* module);
-    virtual ~LeafFloorplan(); 
 };
 
 struct Floorplan
@@ -32,30 +57,58 @@ struct Floorplan
         V
     };
 
-    BaseFloorplan* left;
-    BaseFloorplan* right;
+    Index left;
+    Index right;
     Type type;
+
+    // Set when the children changed places and the coordinates below this
+    // floorplan were not recalculated yet. Sizes never change, so the
+    // position of a child follows from the parent and the size of the left
+    // sibling; absolute coordinates are only fixed when they are needed.
     bool swap;
 
-    Floorplan(BaseFloorplan* l, BaseFloorplan* r, Type t);
-    virtual ~Floorplan();
+    Floorplan(); // constructs an empty slot, see FloorplanArena::reserveFloorplans
+    Floorplan(const FloorplanArena& arena, Index l, Index r, Type t);
 
 //    bool swapCondition(const Floorplan* f, Point p) const;
 
-    Rectangle mergedRect() const;
-    Point mergedCenterOfGravity() const;
+    Rectangle mergedRect(const FloorplanArena& arena) const;
+    Point mergedCenterOfGravity(const FloorplanArena& arena) const;
 
-    void swapChildren();
-    void swapCoordinates();
-	void recalculateTree();
+    // Takes O(1) time: only marks the coordinates below as stale
+    void swapChildren(FloorplanArena& arena);
+    void recalculateTree(FloorplanArena& arena);
 
     // Used for fixing coords of children based on root coords
     // This is needed, because after upward optimiziation coords
-    // of children need to be fixed if their roots are swapped
-    void recalculateChildrenCoords();
-
-private:
-	void _recalculateTree(BaseFloorplan* root);
+    // of children need to be fixed if their roots are swapped.
+    // Children which moved are marked, as their subtrees are stale now.
+    void recalculateChildrenCoords(FloorplanArena& arena);
 };
 
+inline bool BaseFloorplan::isLeaf() const
+{
+    return kind == LEAF;
+}
+
+inline LeafFloorplan* BaseFloorplan::asLeaf()
+{
+    return isLeaf() ? static_cast<LeafFloorplan*>(this) : 0;
+}
+
+inline const LeafFloorplan* BaseFloorplan::asLeaf() const
+{
+    return isLeaf() ? static_cast<const LeafFloorplan*>(this) : 0;
+}
+
+inline Floorplan* BaseFloorplan::asFloorplan()
+{
+    return isLeaf() ? 0 : static_cast<Floorplan*>(this);
+}
+
+inline const Floorplan* BaseFloorplan::asFloorplan() const
+{
+    return isLeaf() ? 0 : static_cast<const Floorplan*>(this);
+}
+
 #endif
@@ -1,5 +1,59 @@
 #include "Geometry.h"
 #include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+Coordinate snapToDatabaseUnits(double value)
+{
+#ifdef FLOORPLANNER_INTEGER_COORDINATES
+    const double units = std::round(toDatabaseUnits(value));
+    if (!(units >= std::numeric_limits<Coordinate>::min() && units <= std::numeric_limits<Coordinate>::max())) {
+        throw std::runtime_error("Coordinate " + std::to_string(value) + " is out of the range of database units");
+    }
+    return static_cast<Coordinate>(units);
+#else
+    return value;
+#endif
+}
+
+Rectangle snapToDatabaseUnits(double x, double y, double width, double height)
+{
+#ifdef FLOORPLANNER_INTEGER_COORDINATES
+    const Coordinate left = snapToDatabaseUnits(x);
+    const Coordinate bottom = snapToDatabaseUnits(y);
+    const Coordinate right = snapToDatabaseUnits(x + width);
+    const Coordinate top = snapToDatabaseUnits(y + height);
+    if (static_cast<double>(right) - left > std::numeric_limits<Coordinate>::max()
+            || static_cast<double>(top) - bottom > std::numeric_limits<Coordinate>::max()) {
+        throw std::runtime_error("Rectangle is too large for database units");
+    }
+    if (width > 0 && height > 0 && (right <= left || top <= bottom)) {
+        throw std::runtime_error("Rectangle is smaller than a database unit");
+    }
+    return Rectangle(left, bottom, right - left, top - bottom);
+#else
+    return Rectangle(x, y, width, height);
+#endif
+}
+
+double toDatabaseUnits(double value)
+{
+#ifdef FLOORPLANNER_INTEGER_COORDINATES
+    return value * FLOORPLANNER_DATABASE_UNITS;
+#else
+    return value;
+#endif
+}
+
+double fromDatabaseUnits(double value)
+{
+#ifdef FLOORPLANNER_INTEGER_COORDINATES
+    return value / FLOORPLANNER_DATABASE_UNITS;
+#else
+    return value;
+#endif
+}
 
 Point Point::undefined = Point(-1, -1);
 
@@ -51,7 +105,7 @@ void Point::shiftY(double deltaY)
     }
 }
 
-Rectangle::Rectangle(double x, double y, double width, double height)
+Rectangle::Rectangle(Coordinate x, Coordinate y, Coordinate width, Coordinate height)
     : m_x(x)
     , m_y(y)
     , m_width(width)
@@ -67,52 +121,52 @@ Rectangle::Rectangle()
 {
 }
     
-double Rectangle::top() const
+Coordinate Rectangle::top() const
 {
     return m_y + m_height;
 }
     
-double Rectangle::bottom() const
+Coordinate Rectangle::bottom() const
 {
     return m_y;
 }
 
-double Rectangle::left() const
+Coordinate Rectangle::left() const
 {
     return m_x;
 }
     
-double Rectangle::right() const
+Coordinate Rectangle::right() const
 {
     return m_x + m_width;
 }
     
-double Rectangle::x() const
+Coordinate Rectangle::x() const
 {
     return m_x;
 }
 
-double Rectangle::y() const
+Coordinate Rectangle::y() const
 {
     return m_y;
 }
 
-double Rectangle::height() const
+Coordinate Rectangle::height() const
 {
     return m_height;
 }
 
-double Rectangle::width() const
+Coordinate Rectangle::width() const
 {
     return m_width;
 }
 
-void Rectangle::setX(double x)
+void Rectangle::setX(Coordinate x)
 {
 	m_x = x;
 }
 
-void Rectangle::setY(double y)
+void Rectangle::setY(Coordinate y)
 {
 	m_y = y;
 }
@@ -1,6 +1,36 @@
 #ifndef GEOMETRY_H
 #define GEOMETRY_H
 
+#include <cstdint>
+
+// Coordinates of the rectangles in the tree. Building with
+// FLOORPLANNER_INTEGER_COORDINATES (qmake CONFIG+=integer_coordinates) makes
+// them integers in database units of 1 / FLOORPLANNER_DATABASE_UNITS: input
+// is snapped to the grid when loaded, nodes get smaller and siblings are
+// matched exactly. Centers of gravity and weights stay double.
+#ifdef FLOORPLANNER_INTEGER_COORDINATES
+typedef std::int32_t Coordinate;
+#else
+typedef double Coordinate;
+#endif
+
+#ifndef FLOORPLANNER_DATABASE_UNITS
+#define FLOORPLANNER_DATABASE_UNITS 1
+#endif
+
+// Conversions between the units of the files and database units, identities
+// without FLOORPLANNER_INTEGER_COORDINATES.
+// Throws std::runtime_error if the value does not fit a Coordinate.
+Coordinate snapToDatabaseUnits(double value);
+double toDatabaseUnits(double value);
+double fromDatabaseUnits(double value);
+
+class Rectangle;
+
+// Snaps the edges rather than the sizes, so that abutting rectangles still
+// abut in database units
+Rectangle snapToDatabaseUnits(double x, double y, double width, double height);
+
 struct Point
 {
     static Point undefined;
@@ -24,25 +54,25 @@ class Rectangle
 {
 public:
     Rectangle();
-    Rectangle(double x, double y, double height, double width);
+    Rectangle(Coordinate x, Coordinate y, Coordinate width, Coordinate height);
     
-    double top() const;
-    double bottom() const;
-    double left() const;
-    double right() const;
-    double x() const;
-    double y() const;
-    double width() const;
-    double height() const;
-
-	void setX(double x);
-	void setY(double y);
+    Coordinate top() const;
+    Coordinate bottom() const;
+    Coordinate left() const;
+    Coordinate right() const;
+    Coordinate x() const;
+    Coordinate y() const;
+    Coordinate width() const;
+    Coordinate height() const;
+
+	void setX(Coordinate x);
+	void setY(Coordinate y);
 
 private:
-    double m_x;
-    double m_y;
-    double m_width;
-    double m_height;
+    Coordinate m_x;
+    Coordinate m_y;
+    Coordinate m_width;
+    Coordinate m_height;
 };
 
 #endif
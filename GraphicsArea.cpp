@@ -1,10 +1,17 @@
 #include "GraphicsArea.h"
+#include "Profiler.h"
 
+#include <QApplication>
 #include <QDebug>
 #include <QPainter>
 #include <QColor>
+#include <QMouseEvent>
+#include <QWheelEvent>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <vector>
 
 static const GraphicsArea::ColorType colors_data[] = {Qt::black, Qt::darkBlue, Qt::darkGreen};
 const GraphicsArea::ColorType* GraphicsArea::colors = colors_data;
@@ -12,7 +19,16 @@ const GraphicsArea::ColorType* GraphicsArea::colors = colors_data;
 GraphicsArea::GraphicsArea(QWidget* parent)
     : QWidget(parent)
     , m_target(0)
-    , m_floorplan(0)    
+    , m_structure(0)
+    , m_arena(0)
+    , m_scale(1)
+    , m_xShift(0)
+    , m_yShift(0)
+    , m_fitted(true)
+    , m_panning(false)
+    , m_dragged(false)
+    , m_pixmapValid(false)
+    , m_selectedLeavesValid(false)
 {
 
 }
@@ -41,45 +57,155 @@ Point GraphicsArea::recalculatePoint(const QPoint& point) const
     return Point(result.x(), result.y());
 }
 
-void GraphicsArea::drawFloorplan(BaseFloorplan* root)
+void GraphicsArea::drawFloorplan(QPainter& painter, const BaseFloorplan* root)
 {
-    _drawFloorplan(root, 0);
-}
+    // The slicing tree is a spatial index of its own: every floorplan
+    // covers its children, so subtrees outside the view are skipped as a
+    // whole, and subtrees thinner than minDetailSize pixels are drawn as one
+    // box instead of being visited.
+    // Rectangles are collected per pen and brush and drawn in a few batches:
+    // those boxes, leaves by color and selection, then the outlines of
+    // floorplans over them, then the names of leaves large enough to show them
+    std::vector<QRect> boxes;
+    std::vector<QRect> leaves[3][2];
+    std::vector<QRect> floorplans[3];
+    std::vector<std::pair<QPoint, const Module*> > names;
 
-void GraphicsArea::_drawFloorplan(BaseFloorplan* root, unsigned short colorIdx)
-{
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(root);
-    if (0 != floorplan)
+    struct Item
     {
-        // Pick a different color for the parent and children
-        _drawFloorplan(floorplan->left, (colorIdx + 1) % 3);
-        _drawFloorplan(floorplan->right, (colorIdx + 2) % 3);
+        const BaseFloorplan* node;
+        unsigned short colorIdx;
+    };
+    Item first = {root, 0};
+    std::vector<Item> stack(1, first);
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        const QRectF view = toView(item.node->rect);
+        if (!view.intersects(viewBounds())) {
+            continue;
+        }
+        const QRect rect = clipToView(view);
+        if (view.width() < minDetailSize || view.height() < minDetailSize) {
+            boxes.push_back(rect);
+            continue;
+        }
+        const Floorplan* floorplan = item.node->asFloorplan();
+        if (0 != floorplan) {
+            // Pick a different color for the parent and children
+            floorplans[item.colorIdx].push_back(rect);
+            Item right = {m_arena->right(floorplan), static_cast<unsigned short>((item.colorIdx + 2) % 3)};
+            Item left = {m_arena->left(floorplan), static_cast<unsigned short>((item.colorIdx + 1) % 3)};
+            stack.push_back(right);
+            stack.push_back(left);
+            continue;
+        }
+        const LeafFloorplan* leaf = item.node->asLeaf();
+        const bool selected = m_selectedModules.find(leaf->module) != m_selectedModules.end();
+        leaves[item.colorIdx][selected ? 1 : 0].push_back(rect);
+        if (view.width() >= minNamedSize && view.height() >= minNamedSize) {
+            names.push_back(std::make_pair(rect.topLeft() + QPoint(10, 15), leaf->module));
+        }
     }
 
-    QPainter painter(this);
-    double x  = m_xShift + root->rect.x() * m_scale;
-    double y = m_yShift + root->rect.y() * m_scale;
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QBrush(QColor(Qt::gray)));
+    painter.drawRects(boxes.data(), static_cast<int>(boxes.size()));
+    drawSelectedLeaves(painter);
 
-    QRect rect = QRect(x, y, root->rect.width() * m_scale, root->rect.height() * m_scale);
-    QPen pen(colors[colorIdx]);
+    QPen pen;
     pen.setWidth(2);
+    const QBrush fills[2] = {QBrush(QColor(Qt::white)), QBrush(QColor(Qt::darkGray))};
+    for (int c = 0; c < 3; ++c) {
+        pen.setColor(colors[c]);
+        painter.setPen(pen);
+        for (int selected = 0; selected < 2; ++selected) {
+            painter.setBrush(fills[selected]);
+            painter.drawRects(leaves[c][selected].data(), static_cast<int>(leaves[c][selected].size()));
+        }
+    }
+    painter.setBrush(Qt::NoBrush);
+    for (int c = 0; c < 3; ++c) {
+        pen.setColor(colors[c]);
+        painter.setPen(pen);
+        painter.drawRects(floorplans[c].data(), static_cast<int>(floorplans[c].size()));
+    }
+    pen.setColor(Qt::black);
     painter.setPen(pen);
+    std::vector<std::pair<QPoint, const Module*> >::const_iterator it;
+    for (it = names.begin(); it != names.end(); ++it) {
+        painter.drawText(it->first, QString::fromStdString(it->second->name));
+    }
+}
 
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(root);
-    if (0 != leaf) {
-        if (m_selectedModules.find(leaf->module) != m_selectedModules.end()) {
-            painter.setBrush(QBrush(QColor(Qt::darkGray)));
-        } else {
-            painter.setBrush(QBrush(QColor(Qt::white)));
+void GraphicsArea::drawSelectedLeaves(QPainter& painter)
+{
+    // Selected leaves inside the boxes are drawn over them at the smallest
+    // visible size, so that nets stay visible in a zoomed out view
+    if (!m_selectedLeavesValid) {
+        m_selectedLeaves.clear();
+        if (!m_selectedModules.empty()) {
+            for (std::size_t i = 0; i < m_arena->leafCount(); ++i) {
+                const FloorplanArena::Index index = static_cast<FloorplanArena::Index>(i) | FloorplanArena::leafBit;
+                if (m_selectedModules.find(m_arena->leaf(index)->module) != m_selectedModules.end()) {
+                    m_selectedLeaves.push_back(index);
+                }
+            }
+        }
+        m_selectedLeavesValid = true;
+    }
+
+    std::vector<QRect> selected;
+    std::vector<FloorplanArena::Index>::const_iterator it;
+    for (it = m_selectedLeaves.begin(); it != m_selectedLeaves.end(); ++it) {
+        QRectF view = toView(m_arena->leaf(*it)->rect);
+        if (view.width() >= minDetailSize && view.height() >= minDetailSize) {
+            continue;
+        }
+        view.setWidth(std::max<double>(view.width(), minDetailSize));
+        view.setHeight(std::max<double>(view.height(), minDetailSize));
+        if (view.intersects(viewBounds())) {
+            selected.push_back(clipToView(view));
         }
-        painter.drawRect(rect);
-        pen.setColor(Qt::black);
-        painter.setPen(pen);
-        painter.drawText(QPointF(x + 10, y + 15), QString::fromStdString(leaf->module->name));
-        return;
-    } else {
-        painter.drawRect(rect);
     }
+    painter.setBrush(QBrush(QColor(Qt::darkGray)));
+    painter.drawRects(selected.data(), static_cast<int>(selected.size()));
+}
+
+QRectF GraphicsArea::toView(const Rectangle& rect) const
+{
+    return QRectF(m_xShift + rect.x() * m_scale, m_yShift + rect.y() * m_scale,
+                  rect.width() * m_scale, rect.height() * m_scale);
+}
+
+QRectF GraphicsArea::viewBounds() const
+{
+    // Outlines of nodes just outside the widget do not reach into it
+    const double margin = 4;
+    return QRectF(-margin, -margin, width() + 2 * margin, height() + 2 * margin);
+}
+
+QRect GraphicsArea::clipToView(const QRectF& view) const
+{
+    // Clipped first, as zoomed in rectangles may not fit into int
+    const QRectF clipped = view.intersected(viewBounds());
+    return QRect(static_cast<int>(clipped.x()), static_cast<int>(clipped.y()),
+                 std::max(1, static_cast<int>(clipped.width())), std::max(1, static_cast<int>(clipped.height())));
+}
+
+void GraphicsArea::renderPixmap()
+{
+    if (m_pixmap.size() != size()) {
+        m_pixmap = QPixmap(size());
+    }
+    m_pixmap.fill(QColor(Qt::black));
+    const BaseFloorplan* root = floorplan();
+    if (root != 0) {
+        m_structure->updateCoordinates();
+        QPainter painter(&m_pixmap);
+        drawFloorplan(painter, root);
+    }
+    m_pixmapValid = true;
 }
 
 void GraphicsArea::reset()
@@ -89,18 +215,22 @@ void GraphicsArea::reset()
         m_target = 0;
     }
 
-    delete m_floorplan;
-    m_floorplan = 0;
+    // Nodes and modules are owned by the window, which may free them now
+    m_structure = 0;
+    m_arena = 0;
+    m_selectedModules.clear();
+    m_pixmapValid = false;
+    m_selectedLeavesValid = false;
+    m_fitted = true;
     draw();
 }
 
-void GraphicsArea::drawTarget()
+void GraphicsArea::drawTarget(QPainter& painter)
 {
     if (!m_target) {
         return;
     }
 
-    QPainter painter(this);
     QPen pen(QColor(Qt::black));
     pen.setWidth(1);
     painter.setPen(pen);
@@ -112,32 +242,90 @@ void GraphicsArea::drawTarget()
     painter.drawEllipse(QPoint(x, y), 4, 4);
 }
 
-void GraphicsArea::setFloorplan(BaseFloorplan* floorplan)
+void GraphicsArea::setFloorplan(const SlicingStructure* structure)
 {
-    m_floorplan = floorplan;
-    calculateScaleAndPosition();
+    // Runs and undo keep the outline, and with it a zoomed view
+    const BaseFloorplan* previous = floorplan();
+    const BaseFloorplan* root = structure->floorplan();
+    const bool sameOutline = previous != 0 && root != 0
+            && previous->rect.width() == root->rect.width() && previous->rect.height() == root->rect.height();
+    m_structure = structure;
+    m_arena = &structure->arena();
+    m_pixmapValid = false;
+    m_selectedLeavesValid = false;
+    if (m_fitted || !sameOutline) {
+        calculateScaleAndPosition();
+    }
+}
+
+const BaseFloorplan* GraphicsArea::floorplan() const
+{
+    // Not cached, as the structure may move its nodes, see SlicingStructure::compact
+    return (0 == m_structure) ? 0 : m_structure->floorplan();
+}
+
+double GraphicsArea::fittedScale() const
+{
+    const BaseFloorplan* root = floorplan();
+    if (0 == root) {
+        return 1;
+    }
+    if (root->rect.width() >= root->rect.height()) {
+        return (double)this->width() / root->rect.width();
+    }
+    return (double)this->height() / root->rect.height();
 }
 
 void GraphicsArea::calculateScaleAndPosition()
 {
-    if (0 == m_floorplan) {
+    m_fitted = true;
+    const BaseFloorplan* root = floorplan();
+    if (0 == root) {
         return;
     }
 
-    if (m_floorplan->rect.width() >= m_floorplan->rect.height()) {
-        m_scale = (double)this->width() / m_floorplan->rect.width();
-        m_yShift = (this->height() - m_scale * m_floorplan->rect.height()) / 2.0;
+    m_scale = fittedScale();
+    if (root->rect.width() >= root->rect.height()) {
+        m_yShift = (this->height() - m_scale * root->rect.height()) / 2.0;
         m_xShift = 0;
     } else {
-        m_scale = (double)this->height() / m_floorplan->rect.height();
         m_yShift = 0;
-        m_xShift = (this->width() - m_scale * m_floorplan->rect.width()) / 2.0;
+        m_xShift = (this->width() - m_scale * root->rect.width()) / 2.0;
     }
 }
 
+void GraphicsArea::zoom(double factor, const QPointF& anchor)
+{
+    if (0 == floorplan()) {
+        return;
+    }
+    const double fitted = fittedScale();
+    const double scale = std::min(std::max(m_scale * factor, fitted * minZoom), fitted * maxZoom);
+    factor = scale / m_scale;
+
+    // The model point under the anchor stays in place
+    m_xShift = anchor.x() - (anchor.x() - m_xShift) * factor;
+    m_yShift = anchor.y() - (anchor.y() - m_yShift) * factor;
+    m_scale = scale;
+    m_fitted = false;
+    m_pixmapValid = false;
+    draw();
+}
+
+void GraphicsArea::pan(const QPoint& offset)
+{
+    m_xShift += offset.x();
+    m_yShift += offset.y();
+    m_fitted = false;
+    m_pixmapValid = false;
+    draw();
+}
+
 void GraphicsArea::setSelectedItems(std::set<Module*> modules)
 {
     m_selectedModules = modules;
+    m_pixmapValid = false;
+    m_selectedLeavesValid = false;
 }
 
 void GraphicsArea::setTargetPoint(const Point& point)
@@ -147,19 +335,85 @@ void GraphicsArea::setTargetPoint(const Point& point)
 
 void GraphicsArea::paintEvent(QPaintEvent* /* e */)
 {
-    m_pixmap = QPixmap(this->size());
-    m_pixmap.fill(QColor(Qt::black));
-
+    // The floorplan is rendered only when it, the selection or the size
+    // changed; other repaints copy the pixmap and draw the target over it
+    ScopedTimer timer("paint");
+    if (!m_pixmapValid) {
+        renderPixmap();
+    }
     QPainter painter(this);
     painter.drawPixmap(0, 0, m_pixmap);
-    if (m_floorplan != 0) {
-        drawFloorplan(m_floorplan);
-        drawTarget();
+    if (floorplan() != 0) {
+        drawTarget(painter);
     }
 }
 
 void GraphicsArea::resizeEvent(QResizeEvent *)
 {
+    if (m_fitted) {
+        calculateScaleAndPosition();
+    }
+    m_pixmapValid = false;
+    draw();
+}
+
+void GraphicsArea::wheelEvent(QWheelEvent* e)
+{
+    // A notch of the wheel zooms by 1.25 around the cursor
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QPointF anchor = e->position();
+    const int delta = e->angleDelta().y();
+#else
+    const QPointF anchor = e->pos();
+    const int delta = e->delta();
+#endif
+    zoom(std::pow(1.25, delta / 120.0), anchor);
+    e->accept();
+}
+
+void GraphicsArea::mousePressEvent(QMouseEvent* e)
+{
+    if (e->button() == Qt::LeftButton) {
+        m_panning = true;
+        m_dragged = false;
+        m_pressPosition = e->pos();
+        m_lastMousePosition = e->pos();
+    }
+    QWidget::mousePressEvent(e);
+}
+
+void GraphicsArea::mouseMoveEvent(QMouseEvent* e)
+{
+    // Small moves of a click do not pan yet
+    if (m_panning && !m_dragged) {
+        m_dragged = (e->pos() - m_pressPosition).manhattanLength() >= QApplication::startDragDistance();
+    }
+    if (m_panning && m_dragged) {
+        pan(e->pos() - m_lastMousePosition);
+        m_lastMousePosition = e->pos();
+    }
+    QWidget::mouseMoveEvent(e);
+}
+
+void GraphicsArea::mouseReleaseEvent(QMouseEvent* e)
+{
+    if (e->button() == Qt::LeftButton && m_panning) {
+        m_panning = false;
+        if (!m_dragged && 0 != m_structure) {
+            Module* module = m_structure->moduleAt(recalculatePoint(e->pos()));
+            if (0 != module) {
+                emit moduleClicked(module);
+            }
+        }
+    }
+    QWidget::mouseReleaseEvent(e);
+}
+
+void GraphicsArea::mouseDoubleClickEvent(QMouseEvent* e)
+{
+    // Back to the whole floorplan
     calculateScaleAndPosition();
+    m_pixmapValid = false;
     draw();
+    QWidget::mouseDoubleClickEvent(e);
 }
@@ -1,16 +1,21 @@
 #ifndef GRAPHICSAREA_H
 #define GRAPHICSAREA_H
 
-#include "Floorplans.h"
+#include "SlicingStructure.h"
 
 #include <QWidget>
 #include <QPixmap>
 
 #include <set>
+#include <vector>
+
+class QPainter;
 
 class GraphicsArea
     : public QWidget
 {
+    Q_OBJECT
+
 public:
 
     typedef Qt::GlobalColor ColorType;
@@ -23,29 +28,72 @@ public:
 
     void reset();
     void draw();
-    void setFloorplan(BaseFloorplan* floorplan);
+
+    // Keeps a zoomed view if the floorplan has the same outline as the
+    // previous one, as after a run; fits the new floorplan otherwise
+    void setFloorplan(const SlicingStructure* structure);
     void setSelectedItems(std::set<Module*> modules);
     void setTargetPoint(const Point& point);
 
+    // Scales the view by factor around the anchor point of the widget.
+    // The wheel zooms around the cursor, dragging with the left button
+    // pans and a double click fits the whole floorplan again.
+    void zoom(double factor, const QPointF& anchor);
+    void pan(const QPoint& offset);
+
+signals:
+    // A click, as opposed to a drag, on a block of the floorplan
+    void moduleClicked(Module* module);
+
 protected:
     virtual void paintEvent(QPaintEvent* e);
     virtual void resizeEvent(QResizeEvent *);
+    virtual void wheelEvent(QWheelEvent* e);
+    virtual void mousePressEvent(QMouseEvent* e);
+    virtual void mouseMoveEvent(QMouseEvent* e);
+    virtual void mouseReleaseEvent(QMouseEvent* e);
+    virtual void mouseDoubleClickEvent(QMouseEvent* e);
 
 private:
-    void drawFloorplan(BaseFloorplan* root);
-    void _drawFloorplan(BaseFloorplan* root, unsigned short colorIdx);
+    // Leaves smaller than this in pixels are drawn without their names,
+    // nodes thinner than this as a box without their subtree
+    static const int minNamedSize = 20;
+    static const int minDetailSize = 2;
+
+    // Limits of the scale relative to the fitted one
+    static constexpr double minZoom = 0.25;
+    static constexpr double maxZoom = 1e6;
+
+    void renderPixmap();
+    void drawFloorplan(QPainter& painter, const BaseFloorplan* root);
+    void drawSelectedLeaves(QPainter& painter);
+    QRectF toView(const Rectangle& rect) const;
+    QRectF viewBounds() const;
+    QRect clipToView(const QRectF& view) const;
 
-    void drawTarget();
-    void calculateScaleAndPosition();
+    const BaseFloorplan* floorplan() const;
+    void drawTarget(QPainter& painter);
+    double fittedScale() const;
+    void calculateScaleAndPosition();   // fits the whole floorplan
 
 private:
-    QPixmap m_pixmap;
+    QPixmap m_pixmap;       // the floorplan without the target
     Point* m_target;
-    BaseFloorplan* m_floorplan;
+    const SlicingStructure* m_structure;
+    const FloorplanArena* m_arena;
     std::set<Module*> m_selectedModules;
     double m_scale;
     double m_xShift;
     double m_yShift;
+    bool m_fitted;      // follows the size of the widget
+    bool m_panning;
+    bool m_dragged;     // moved too far since the press to be a click
+    QPoint m_pressPosition;
+    QPoint m_lastMousePosition;
+    bool m_pixmapValid;
+    // Leaves of the selected modules, found when first drawn
+    std::vector<FloorplanArena::Index> m_selectedLeaves;
+    bool m_selectedLeavesValid;
 
 };
 
@@ -1,82 +1,716 @@
 #include "InputOutputManager.h"
 
+#include "MappedFile.h"
+#include "Profiler.h"
+#include "Progress.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include <stdexcept>
 #include <string>
-#include <cassert>
-#include <sstream>
-#include <regex>
 
-#include <boost/algorithm/string.hpp>
+namespace {
 
-std::pair<std::vector<Module*>, std::set<Module*> > readBlocks(std::string fileName)
+// Lines of one part of the input; modules and lines are counted from the
+// start of the part
+struct ParsedChunk
 {
-    std::ifstream inFile;
-    inFile.open(fileName.c_str());
-    if (inFile.fail()) {
-        throw std::runtime_error("Cannot read the file " + fileName);
+    ParsedChunk()
+        : lines(0)
+        , errorLine(0)
+        , error(0)
+    {
     }
 
-    std::vector<Module*> modules;
-    std::regex numEx("([0-9]*\\.?[0-9]*) ([0-9]*\\.?[0-9]*) ([0-9]*\\.?[0-9]*) ([0-9]*\\.?[0-9]*)( \\+)?");
-    std::smatch match;
-    std::string line;
-    int counter = 0;
-    std::set<Module*> netModules;
-    while (std::getline(inFile, line)) {
-        boost::trim(line);
-        if (std::regex_match(line, match, numEx)) {
-            assert(match.size() == 6);
-            double x = (double)atof(match[1].str().c_str());
-            double y = (double)atof(match[2].str().c_str());
-            double width = (double)atof(match[3].str().c_str());
-            double height = (double)atof(match[4].str().c_str());
-            std::string name = static_cast<std::ostringstream*>( &(std::ostringstream() << (++counter)) )->str();
-            Module* module = new Module(x, y, width, height, name);
-            modules.push_back(module);
-            std::string status = match[5].str();
-            boost::trim(status);
-            bool isFromNet = (status == "+") ? true : false;
-            if (isFromNet) {
-                netModules.insert(module);
+    std::vector<double> coordinates;    // x, y, width and height of every module
+    std::vector<Netlist::Pin> pins;
+    std::size_t lines;
+    std::size_t errorLine;              // 0 if all lines are well formed
+    const char* error;
+};
+
+// Same characters as std::isspace in the "C" locale
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Reads [0-9]*\.?[0-9]* with at least one digit
+bool parseNumber(const char*& p, const char* end, double& value)
+{
+    const char* begin = p;
+    bool digits = false;
+    while (p != end && isDigit(*p)) {
+        ++p;
+        digits = true;
+    }
+    if (p != end && *p == '.') {
+        ++p;
+    }
+    while (p != end && isDigit(*p)) {
+        ++p;
+        digits = true;
+    }
+    if (!digits) {
+        return false;
+    }
+    std::from_chars_result result = std::from_chars(begin, p, value);
+    if (result.ec == std::errc::result_out_of_range) {
+        // Rounded to infinity or zero, like strtod does
+        value = std::strtod(std::string(begin, p).c_str(), 0);
+        return true;
+    }
+    return result.ec == std::errc() && result.ptr == p;
+}
+
+// Parses "x y width height" followed by any number of " +" or " <net id>"
+// after trimming whitespace. Returns the reason if the line is malformed.
+const char* parseLine(const char* p, const char* end, ParsedChunk& chunk)
+{
+    while (p != end && isSpace(*p)) {
+        ++p;
+    }
+    while (end != p && isSpace(*(end - 1))) {
+        --end;
+    }
+
+    double values[4];
+    for (int i = 0; i < 4; ++i) {
+        if (i > 0) {
+            if (p == end || *p != ' ') {
+                return "expected four numbers separated by spaces";
             }
-        } else {
-            throw std::runtime_error("Input file is in a wrong format!");
+            ++p;
+        }
+        // An empty field would shift the rest, making the height a net id
+        if (p == end || *p == ' ') {
+            return "expected four numbers separated by spaces";
+        }
+        if (!parseNumber(p, end, values[i])) {
+            return "malformed number";
+        }
+    }
+
+    // "+" marks a module of the net 0, numbers give ids of nets
+    const Netlist::Id module = static_cast<Netlist::Id>(chunk.coordinates.size() / 4);
+    while (p != end) {
+        if (*p != ' ') {
+            return "unexpected character";
+        }
+        ++p;
+        if (p != end && *p == '+') {
+            ++p;
+            chunk.pins.push_back(Netlist::Pin(module, 0));
+            continue;
+        }
+        const char* begin = p;
+        while (p != end && isDigit(*p)) {
+            ++p;
+        }
+        unsigned long long net = 0;
+        if (p == begin) {
+            return "expected a net id or +";
+        }
+        if (std::from_chars(begin, p, net).ec != std::errc() || net > std::numeric_limits<Netlist::Id>::max()) {
+            return "net id out of range";
+        }
+        chunk.pins.push_back(Netlist::Pin(module, static_cast<Netlist::Id>(net)));
+    }
+
+    chunk.coordinates.insert(chunk.coordinates.end(), values, values + 4);
+    return 0;
+}
+
+// Stops at the first malformed line
+void parseChunk(const char* p, const char* end, ParsedChunk& chunk)
+{
+    while (p != end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* lineEnd = (0 != eol) ? eol : end;
+        ++chunk.lines;
+        chunk.error = parseLine(p, lineEnd, chunk);
+        if (0 != chunk.error) {
+            chunk.errorLine = chunk.lines;
+            return;
+        }
+        p = (0 != eol) ? eol + 1 : end;
+    }
+}
+
+// Runs task(i) for every i below count, on the pool if there is one
+template <typename Task>
+void runChunks(ThreadPool* pool, std::size_t count, const Task& task)
+{
+    if (0 == pool || count < 2) {
+        for (std::size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+    ThreadPool::TaskGroup group(*pool);
+    for (std::size_t i = 0; i < count; ++i) {
+        group.run([&task, i] { task(i); });
+    }
+    group.wait();
+}
+
+// Layout of binary design files. Numbers are stored in the byte order of
+// the writing machine, and every section starts at a multiple of 8 bytes,
+// so the arrays are used in place from the mapped file.
+const char binaryMagic[8] = {'S', 'L', 'I', 'C', 'E', 'F', 'P', '\0'};
+const std::uint32_t binaryByteOrder = 0x01020304u;
+const std::uint32_t binaryVersion = 1;
+const std::uint32_t deltaCoordinatesFlag = 1;
+
+struct BinaryHeader
+{
+    char magic[8];
+    std::uint32_t byteOrder;
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint32_t moduleCount;
+    std::uint32_t floorplanCount;
+    std::uint32_t reserved;
+    std::uint64_t pinCount;
+    std::uint64_t floorplansOffset;         // floorplanCount BinaryFloorplan, in pre-order
+    std::uint64_t leavesOffset;             // x, y, width, height of every module
+    std::uint64_t leavesSize;
+    std::uint64_t moduleNetOffsetsOffset;   // moduleCount + 1 offsets into the nets
+    std::uint64_t moduleNetsOffset;         // pinCount net ids
+};
+
+static_assert(sizeof(BinaryHeader) == 80, "binary header must not have padding");
+
+// Children are FloorplanArena indices: leaves have the leaf bit set, and
+// floorplans are numbered by their position in pre-order
+struct BinaryFloorplan
+{
+    std::uint32_t left;
+    std::uint32_t right;
+    std::uint32_t type;
+    std::uint32_t reserved;
+};
+
+std::uint64_t alignedOffset(std::uint64_t offset)
+{
+    return (offset + 7) & ~std::uint64_t(7);
+}
+
+// Delta coordinates are zigzag encoded variable length integers, which are
+// only exact for integral coordinates
+bool isIntegral(double value)
+{
+    return std::fabs(value) < 9007199254740992.0 && value == std::floor(value) &&
+            !(value == 0 && std::signbit(value));
+}
+
+void writeVarint(std::int64_t value, std::vector<unsigned char>& bytes)
+{
+    std::uint64_t zigzag = (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    while (zigzag >= 0x80) {
+        bytes.push_back(static_cast<unsigned char>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    bytes.push_back(static_cast<unsigned char>(zigzag));
+}
+
+bool readVarint(const unsigned char*& p, const unsigned char* end, std::int64_t& value)
+{
+    std::uint64_t zigzag = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        const unsigned char byte = *p++;
+        zigzag |= std::uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            value = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+            return true;
         }
     }
+    return false;
+}
+
+void writePadded(std::ofstream& outFile, const void* data, std::uint64_t size)
+{
+    static const char zeros[8] = {0};
+    outFile.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    outFile.write(zeros, static_cast<std::streamsize>(alignedOffset(size) - size));
+}
 
-    inFile.close();
+void malformedBinaryDesign(const std::string& fileName, const std::string& reason)
+{
+    throw std::runtime_error("Malformed floorplan file " + fileName + ": " + reason);
+}
+
+// Checks that a section lies within the file
+bool validSection(std::uint64_t offset, std::uint64_t count, std::uint64_t itemSize, std::uint64_t fileSize)
+{
+    return offset % 8 == 0 && offset <= fileSize && count <= (fileSize - offset) / itemSize;
+}
+
+}
 
-    return std::make_pair(modules, netModules);
+std::pair<std::vector<Module*>, std::set<Module*> > readBlocks(std::string fileName, ThreadPool* pool, Progress* progress)
+{
+    std::pair<std::vector<Module*>, Netlist> design = readDesign(fileName, pool, progress);
+    const Netlist& netlist = design.second;
+    std::set<Module*> netModules;
+    // Ids are renumbered in order, so the net 0 comes first if there is one
+    if (netlist.netCount() > 0 && netlist.netId(0) == 0) {
+        for (const Netlist::Id* it = netlist.netModulesBegin(0); it != netlist.netModulesEnd(0); ++it) {
+            netModules.insert(design.first[*it]);
+        }
+    }
+    return std::make_pair(design.first, netModules);
 }
 
-void writeFloorplan(std::string fileName, BaseFloorplan* floorplan, std::set<Module*> modules)
+std::pair<std::vector<Module*>, Netlist> readDesign(std::string fileName, ThreadPool* pool, Progress* progress)
+{
+    ScopedTimer timer("parse");
+    MappedFile file(fileName);
+    const char* data = file.data();
+    const char* end = data + file.size();
+
+    // Split into parts which start right after a line break, a few per
+    // thread so that threads which finish early pick up more
+    const std::size_t minChunkSize = 1 << 20;
+    std::size_t chunkCount = 1;
+    if (0 != pool) {
+        chunkCount = std::min<std::size_t>(4 * pool->size(), file.size() / minChunkSize + 1);
+    }
+    if (0 != progress) {
+        // Parts are the steps of the progress and the checkpoints
+        chunkCount = std::max<std::size_t>(chunkCount, file.size() / (8 * minChunkSize) + 1);
+        progress->start("Parsing", 2 * chunkCount);
+    }
+    std::vector<const char*> bounds(1, data);
+    for (std::size_t i = 1; i < chunkCount; ++i) {
+        const char* p = std::max(data + file.size() / chunkCount * i, bounds.back());
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        bounds.push_back((0 != eol) ? eol + 1 : end);
+    }
+    bounds.push_back(end);
+
+    std::vector<ParsedChunk> chunks(chunkCount);
+    runChunks(pool, chunkCount, [&bounds, &chunks, progress](std::size_t i) {
+        parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+        if (0 != progress) {
+            progress->advance();
+        }
+    });
+
+    // All parts before the first malformed line were parsed completely, so
+    // their lines give its number in the file
+    std::vector<std::size_t> firstModule(chunkCount + 1, 0);
+    std::vector<std::size_t> firstPin(chunkCount + 1, 0);
+    std::size_t line = 0;
+    for (std::size_t i = 0; i < chunkCount; ++i) {
+        if (0 != chunks[i].error) {
+            throw std::runtime_error("Input file is in a wrong format at line " +
+                                     std::to_string(line + chunks[i].errorLine) + ": " + chunks[i].error);
+        }
+        line += chunks[i].lines;
+        firstModule[i + 1] = firstModule[i] + chunks[i].coordinates.size() / 4;
+        firstPin[i + 1] = firstPin[i] + chunks[i].pins.size();
+    }
+
+    // Modules are named by their line, counting from 1
+    std::vector<Module*> modules(firstModule[chunkCount]);
+    std::vector<Netlist::Pin> pins(firstPin[chunkCount]);
+    try {
+        runChunks(pool, chunkCount, [&chunks, &firstModule, &firstPin, &modules, &pins, progress](std::size_t i) {
+            const ParsedChunk& chunk = chunks[i];
+            const std::size_t offset = firstModule[i];
+            for (std::size_t m = 0; m * 4 < chunk.coordinates.size(); ++m) {
+                const double* c = &chunk.coordinates[m * 4];
+                modules[offset + m] = new Module(c[0], c[1], c[2], c[3], std::to_string(offset + m + 1));
+            }
+            for (std::size_t p = 0; p < chunk.pins.size(); ++p) {
+                pins[firstPin[i] + p] = Netlist::Pin(static_cast<Netlist::Id>(offset + chunk.pins[p].first), chunk.pins[p].second);
+            }
+            if (0 != progress) {
+                progress->advance();
+            }
+        });
+    } catch (...) {
+        // Cancelled or out of the range of database units, modules of
+        // other parts may have been created
+        for (std::size_t m = 0; m < modules.size(); ++m) {
+            delete modules[m];
+        }
+        throw;
+    }
+
+    return std::make_pair(modules, Netlist(modules.size(), pins));
+}
+
+void writeFloorplan(std::string fileName, const SlicingStructure& structure, const Netlist& netlist)
 {
     std::ofstream outFile;
     outFile.open(fileName.c_str());
     if (outFile.fail()) {
         throw std::runtime_error("Cannot write to file " + fileName);
     }
-    writeFloorplan(outFile, floorplan, modules);
+    structure.updateCoordinates();
+    writeFloorplan(outFile, structure.arena(), structure.root(), netlist);
     outFile.close();
+    if (outFile.fail()) {
+        throw std::runtime_error("Cannot write to file " + fileName);
+    }
 }
 
-void writeFloorplan(std::ofstream& outFile, BaseFloorplan* root, std::set<Module*> modules)
+void writeFloorplan(std::ostream& outFile, const FloorplanArena& arena, FloorplanArena::Index root, const Netlist& netlist)
 {
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(root);
-    if (0 != leaf) {
-        outFile<<leaf->rect.x()<<" "<<leaf->rect.y()<<" "<<leaf->rect.width()<<" "<<leaf->rect.height();
-        if (modules.find(leaf->module) != modules.end()) {
-            outFile<<" +\n";
-        } else {
-            outFile<<"\n";
-        }
+    ScopedTimer timer("write");
+    if (FloorplanArena::null == root) {
         return;
     }
 
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(root);
-    if (0 != floorplan) {
-        writeFloorplan(outFile, floorplan->left, modules);
-        writeFloorplan(outFile, floorplan->right, modules);
+    // Leaves are the modules of the netlist in the same order. A design with
+    // only the net 0 is written with "+", any other with the ids of the nets.
+    const bool hasNets = netlist.pinCount() != 0;
+    if (hasNets && netlist.moduleCount() != arena.leafCount()) {
+        throw std::runtime_error("The netlist does not match the floorplan");
+    }
+    const bool plus = netlist.netCount() == 1 && netlist.netId(0) == 0;
+
+    // Lines are formatted into a large buffer, which is flushed when the
+    // coordinates of a line or a net id of the longest possible numbers
+    // might not fit any more
+    const std::size_t bufferSize = 1 << 20;
+    const std::size_t maxLineSize = 4 * 330 + 8;
+    const std::size_t maxNetSize = 16;
+    std::vector<char> buffer(bufferSize);
+    char* const begin = buffer.data();
+    char* const end = begin + bufferSize;
+    char* p = begin;
+
+    // Leaves from left to right, with an explicit stack for deep trees
+    std::vector<FloorplanArena::Index> stack(1, root);
+    while (!stack.empty()) {
+        const FloorplanArena::Index index = stack.back();
+        stack.pop_back();
+
+        const Floorplan* floorplan = arena.floorplan(index);
+        if (0 != floorplan) {
+            stack.push_back(floorplan->right);
+            stack.push_back(floorplan->left);
+            continue;
+        }
+
+        // Shortest digits which read back to the same value, and never an
+        // exponent, which readDesign does not accept
+        const Rectangle& rect = arena.node(index)->rect;
+        const double values[4] = {fromDatabaseUnits(rect.x()), fromDatabaseUnits(rect.y()),
+                                  fromDatabaseUnits(rect.width()), fromDatabaseUnits(rect.height())};
+        for (int i = 0; i < 4; ++i) {
+            if (i > 0) {
+                *p++ = ' ';
+            }
+            p = std::to_chars(p, end, values[i], std::chars_format::fixed).ptr;
+        }
+        const Netlist::Id module = index & ~FloorplanArena::leafBit;
+        for (const Netlist::Id* it = hasNets ? netlist.moduleNetsBegin(module) : 0;
+             hasNets && it != netlist.moduleNetsEnd(module); ++it) {
+            if (static_cast<std::size_t>(end - p) < maxNetSize) {
+                outFile.write(begin, p - begin);
+                p = begin;
+            }
+            *p++ = ' ';
+            if (plus) {
+                *p++ = '+';
+            } else {
+                p = std::to_chars(p, end, netlist.netId(*it)).ptr;
+            }
+        }
+        *p++ = '\n';
+
+        if (static_cast<std::size_t>(end - p) < maxLineSize) {
+            outFile.write(begin, p - begin);
+            p = begin;
+        }
+    }
+    outFile.write(begin, p - begin);
+}
+
+bool isBinaryDesign(std::string fileName)
+{
+    std::ifstream inFile(fileName.c_str(), std::ios::binary);
+    char magic[sizeof(binaryMagic)];
+    return inFile.read(magic, sizeof(magic)) && std::memcmp(magic, binaryMagic, sizeof(magic)) == 0;
+}
+
+void writeBinaryDesign(std::string fileName, const SlicingStructure& structure, const Netlist& netlist, bool deltaCoordinates)
+{
+    ScopedTimer timer("write");
+    structure.updateCoordinates();
+    const FloorplanArena& arena = structure.arena();
+    const std::size_t moduleCount = arena.leafCount();
+    if (netlist.moduleCount() != moduleCount && netlist.pinCount() != 0) {
+        throw std::runtime_error("The netlist does not match the floorplan");
+    }
+
+    // Floorplans in pre-order, so that children follow their parents
+    std::vector<BinaryFloorplan> floorplans;
+    floorplans.reserve(arena.floorplanCount());
+    std::vector<FloorplanArena::Index> position(arena.floorplanCount(), FloorplanArena::null);
+    std::vector<FloorplanArena::Index> order;
+    std::vector<FloorplanArena::Index> stack;
+    if (structure.root() != FloorplanArena::null && !FloorplanArena::isLeafIndex(structure.root())) {
+        stack.push_back(structure.root());
+    }
+    while (!stack.empty()) {
+        const FloorplanArena::Index index = stack.back();
+        stack.pop_back();
+        position[index] = static_cast<FloorplanArena::Index>(order.size());
+        order.push_back(index);
+        const Floorplan* floorplan = arena.floorplan(index);
+        if (!FloorplanArena::isLeafIndex(floorplan->right)) {
+            stack.push_back(floorplan->right);
+        }
+        if (!FloorplanArena::isLeafIndex(floorplan->left)) {
+            stack.push_back(floorplan->left);
+        }
+    }
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        const Floorplan* floorplan = arena.floorplan(order[i]);
+        BinaryFloorplan record;
+        record.left = FloorplanArena::isLeafIndex(floorplan->left) ? floorplan->left : position[floorplan->left];
+        record.right = FloorplanArena::isLeafIndex(floorplan->right) ? floorplan->right : position[floorplan->right];
+        record.type = static_cast<std::uint32_t>(floorplan->type);
+        record.reserved = 0;
+        floorplans.push_back(record);
+    }
+
+    std::vector<double> coordinates;
+    coordinates.reserve(4 * moduleCount);
+    bool integral = true;
+    for (std::size_t i = 0; i < moduleCount; ++i) {
+        const Rectangle& rect = arena.leaf(static_cast<FloorplanArena::Index>(i) | FloorplanArena::leafBit)->rect;
+        const double values[4] = {fromDatabaseUnits(rect.x()), fromDatabaseUnits(rect.y()),
+                                  fromDatabaseUnits(rect.width()), fromDatabaseUnits(rect.height())};
+        for (int j = 0; j < 4; ++j) {
+            integral = integral && isIntegral(values[j]);
+            coordinates.push_back(values[j]);
+        }
+    }
+
+    // Positions relative to the previous module, sizes as they are
+    std::vector<unsigned char> deltas;
+    deltaCoordinates = deltaCoordinates && integral;
+    if (deltaCoordinates) {
+        std::int64_t x = 0;
+        std::int64_t y = 0;
+        for (std::size_t i = 0; i < moduleCount; ++i) {
+            const double* c = &coordinates[4 * i];
+            writeVarint(static_cast<std::int64_t>(c[0]) - x, deltas);
+            writeVarint(static_cast<std::int64_t>(c[1]) - y, deltas);
+            writeVarint(static_cast<std::int64_t>(c[2]), deltas);
+            writeVarint(static_cast<std::int64_t>(c[3]), deltas);
+            x = static_cast<std::int64_t>(c[0]);
+            y = static_cast<std::int64_t>(c[1]);
+        }
+    }
+
+    std::vector<std::uint64_t> netOffsets(moduleCount + 1, 0);
+    std::vector<Netlist::Id> nets;
+    nets.reserve(netlist.pinCount());
+    for (std::size_t i = 0; i < moduleCount && netlist.pinCount() != 0; ++i) {
+        const Netlist::Id module = static_cast<Netlist::Id>(i);
+        for (const Netlist::Id* it = netlist.moduleNetsBegin(module); it != netlist.moduleNetsEnd(module); ++it) {
+            nets.push_back(netlist.netId(*it));
+        }
+        netOffsets[i + 1] = nets.size();
+    }
+
+    BinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+    header.byteOrder = binaryByteOrder;
+    header.version = binaryVersion;
+    header.flags = deltaCoordinates ? deltaCoordinatesFlag : 0;
+    header.moduleCount = static_cast<std::uint32_t>(moduleCount);
+    header.floorplanCount = static_cast<std::uint32_t>(floorplans.size());
+    header.pinCount = nets.size();
+    header.floorplansOffset = sizeof(BinaryHeader);
+    header.leavesOffset = header.floorplansOffset + floorplans.size() * sizeof(BinaryFloorplan);
+    header.leavesSize = deltaCoordinates ? deltas.size() : coordinates.size() * sizeof(double);
+    header.moduleNetOffsetsOffset = alignedOffset(header.leavesOffset + header.leavesSize);
+    header.moduleNetsOffset = header.moduleNetOffsetsOffset + netOffsets.size() * sizeof(std::uint64_t);
+
+    std::ofstream outFile(fileName.c_str(), std::ios::binary);
+    if (outFile.fail()) {
+        throw std::runtime_error("Cannot write to file " + fileName);
+    }
+    writePadded(outFile, &header, sizeof(header));
+    writePadded(outFile, floorplans.data(), floorplans.size() * sizeof(BinaryFloorplan));
+    if (deltaCoordinates) {
+        writePadded(outFile, deltas.data(), deltas.size());
+    } else {
+        writePadded(outFile, coordinates.data(), coordinates.size() * sizeof(double));
+    }
+    writePadded(outFile, netOffsets.data(), netOffsets.size() * sizeof(std::uint64_t));
+    writePadded(outFile, nets.data(), nets.size() * sizeof(Netlist::Id));
+    outFile.close();
+    if (outFile.fail()) {
+        throw std::runtime_error("Cannot write to file " + fileName);
+    }
+}
+
+SlicingStructure* readBinaryDesign(std::string fileName, std::pair<std::vector<Module*>, Netlist>& design)
+{
+    ScopedTimer timer("load");
+    MappedFile file(fileName);
+    const std::uint64_t fileSize = file.size();
+    if (fileSize < sizeof(BinaryHeader) || std::memcmp(file.data(), binaryMagic, sizeof(binaryMagic)) != 0) {
+        malformedBinaryDesign(fileName, "not a binary floorplan");
+    }
+    BinaryHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.byteOrder != binaryByteOrder) {
+        malformedBinaryDesign(fileName, "written with another byte order");
+    }
+    if (header.version != binaryVersion || (header.flags & ~deltaCoordinatesFlag) != 0) {
+        malformedBinaryDesign(fileName, "unsupported version " + std::to_string(header.version));
+    }
+
+    const std::size_t moduleCount = header.moduleCount;
+    const std::size_t floorplanCount = header.floorplanCount;
+    const bool delta = (header.flags & deltaCoordinatesFlag) != 0;
+    if (!validSection(header.floorplansOffset, floorplanCount, sizeof(BinaryFloorplan), fileSize) ||
+            !validSection(header.leavesOffset, delta ? header.leavesSize : 4 * std::uint64_t(moduleCount),
+                          delta ? 1 : sizeof(double), fileSize) ||
+            !validSection(header.moduleNetOffsetsOffset, moduleCount + std::uint64_t(1), sizeof(std::uint64_t), fileSize) ||
+            !validSection(header.moduleNetsOffset, header.pinCount, sizeof(Netlist::Id), fileSize)) {
+        malformedBinaryDesign(fileName, "section out of bounds");
+    }
+    const BinaryFloorplan* floorplans = reinterpret_cast<const BinaryFloorplan*>(file.data() + header.floorplansOffset);
+    const std::uint64_t* netOffsets = reinterpret_cast<const std::uint64_t*>(file.data() + header.moduleNetOffsetsOffset);
+    const Netlist::Id* nets = reinterpret_cast<const Netlist::Id*>(file.data() + header.moduleNetsOffset);
+
+    // A tree: the first floorplan is the root, and every other node is the
+    // child of exactly one floorplan before it
+    if (floorplanCount == 0 ? moduleCount > 1 : moduleCount != floorplanCount + 1) {
+        malformedBinaryDesign(fileName, "wrong number of floorplans");
+    }
+    std::vector<bool> hasParent(moduleCount + floorplanCount, false);
+    for (std::size_t i = 0; i < floorplanCount; ++i) {
+        const FloorplanArena::Index children[2] = {floorplans[i].left, floorplans[i].right};
+        for (int j = 0; j < 2; ++j) {
+            const FloorplanArena::Index child = children[j];
+            const std::size_t node = FloorplanArena::isLeafIndex(child) ? (child & ~FloorplanArena::leafBit)
+                                                                        : moduleCount + child;
+            const bool valid = FloorplanArena::isLeafIndex(child) ? node < moduleCount
+                                                                  : (child > i && child < floorplanCount);
+            if (!valid || hasParent[node]) {
+                malformedBinaryDesign(fileName, "floorplan " + std::to_string(i) + " has a wrong child");
+            }
+            hasParent[node] = true;
+        }
+        if (floorplans[i].type > Floorplan::V) {
+            malformedBinaryDesign(fileName, "floorplan " + std::to_string(i) + " has a wrong type");
+        }
+    }
+    if (netOffsets[0] != 0 || netOffsets[moduleCount] != header.pinCount) {
+        malformedBinaryDesign(fileName, "wrong net offsets");
+    }
+    for (std::size_t i = 0; i < moduleCount; ++i) {
+        if (netOffsets[i] > netOffsets[i + 1]) {
+            malformedBinaryDesign(fileName, "wrong net offsets");
+        }
+    }
+
+    // Fixed coordinates are read in place, delta coordinates decoded first
+    std::vector<double> decoded;
+    const double* coordinates = reinterpret_cast<const double*>(file.data() + header.leavesOffset);
+    if (delta) {
+        decoded.reserve(4 * moduleCount);
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(file.data() + header.leavesOffset);
+        const unsigned char* end = p + header.leavesSize;
+        std::int64_t x = 0;
+        std::int64_t y = 0;
+        for (std::size_t i = 0; i < moduleCount; ++i) {
+            std::int64_t values[4];
+            for (int j = 0; j < 4; ++j) {
+                if (!readVarint(p, end, values[j])) {
+                    malformedBinaryDesign(fileName, "truncated coordinates");
+                }
+            }
+            x += values[0];
+            y += values[1];
+            decoded.push_back(static_cast<double>(x));
+            decoded.push_back(static_cast<double>(y));
+            decoded.push_back(static_cast<double>(values[2]));
+            decoded.push_back(static_cast<double>(values[3]));
+        }
+        coordinates = decoded.data();
+    }
+
+    std::vector<Module*> modules(moduleCount);
+    try {
+        for (std::size_t i = 0; i < moduleCount; ++i) {
+            const double* c = coordinates + 4 * i;
+            modules[i] = new Module(c[0], c[1], c[2], c[3], std::to_string(i + 1));
+        }
+    } catch (...) {
+        // Out of the range of database units
+        for (std::size_t m = 0; m < moduleCount; ++m) {
+            delete modules[m];
+        }
+        throw;
+    }
+
+    // Children come after their parents, so filling the floorplans from the
+    // back finds both children complete. This replaces building the tree.
+    FloorplanArena arena;
+    for (std::size_t i = 0; i < moduleCount; ++i) {
+        arena.createLeaf(modules[i]);
+    }
+    arena.reserveFloorplans(floorplanCount);
+    for (std::size_t i = floorplanCount; i-- > 0; ) {
+        const BinaryFloorplan& record = floorplans[i];
+        const Rectangle& left = arena.node(record.left)->rect;
+        const Rectangle& right = arena.node(record.right)->rect;
+        const bool fits = (record.type == Floorplan::H) ? left.width() == right.width()
+                                                        : left.height() == right.height();
+        if (!fits) {
+            for (std::size_t m = 0; m < moduleCount; ++m) {
+                delete modules[m];
+            }
+            malformedBinaryDesign(fileName, "floorplan " + std::to_string(i) + " does not fit its children");
+        }
+        arena.createFloorplanAt(static_cast<FloorplanArena::Index>(i), record.left, record.right,
+                                static_cast<Floorplan::Type>(record.type));
+    }
+
+    std::vector<Netlist::Pin> pins;
+    pins.reserve(header.pinCount);
+    for (std::size_t i = 0; i < moduleCount; ++i) {
+        for (std::uint64_t p = netOffsets[i]; p < netOffsets[i + 1]; ++p) {
+            pins.push_back(Netlist::Pin(static_cast<Netlist::Id>(i), nets[p]));
+        }
+    }
+
+    FloorplanArena::Index root = FloorplanArena::null;
+    if (floorplanCount > 0) {
+        root = 0;
+    } else if (moduleCount == 1) {
+        root = FloorplanArena::leafBit;
     }
+    design.first = modules;
+    design.second = Netlist(moduleCount, pins);
+    return new SlicingStructure(modules, arena, root);
 }
@@ -1,15 +1,49 @@
 #ifndef INPUTREADER_H
 #define INPUTREADER_H
 
+#include <iosfwd>
 #include <vector>
 #include <set>
 #include <utility>
 
 #include "Module.h"
 #include "Floorplans.h"
+#include "Netlist.h"
+#include "SlicingStructure.h"
 
-std::pair<std::vector<Module*>, std::set<Module*> > readBlocks(std::string fileName);
-void writeFloorplan(std::string fileName, BaseFloorplan* floorplan, std::set<Module*> modules);
-void writeFloorplan(std::ofstream& outFile, BaseFloorplan* root, std::set<Module*> modules);
+class Progress;
+class ThreadPool;
+
+// Returns the blocks and the modules of the net 0, marked with "+"
+std::pair<std::vector<Module*>, std::set<Module*> > readBlocks(std::string fileName, ThreadPool* pool = 0,
+                                                               Progress* progress = 0);
+
+// Each line may list ids of nets after the block coordinates, "+" stands
+// for the net 0. The file is mapped into memory and, given a pool, parsed
+// in parts concurrently. Malformed lines are reported with their number.
+// Given a progress, parts are its steps, and Cancelled is thrown between
+// them if it is cancelled.
+std::pair<std::vector<Module*>, Netlist> readDesign(std::string fileName, ThreadPool* pool = 0, Progress* progress = 0);
+
+// Writes the leaves from left to right, each followed by the ids of its
+// nets, so that readDesign gives back the same nets; designs with only the
+// net 0 mark its modules with "+". The netlist may be empty.
+// Numbers are written with the shortest digits that read back exactly.
+void writeFloorplan(std::string fileName, const SlicingStructure& structure, const Netlist& netlist);
+// Expects coordinates to be up to date, see SlicingStructure::updateCoordinates
+void writeFloorplan(std::ostream& outFile, const FloorplanArena& arena, FloorplanArena::Index root, const Netlist& netlist);
+
+// Binary design files keep the finished slicing tree: floorplans with their
+// children in pre-order, leaf rectangles in the order of modules and the
+// nets of every module, in flat arrays which are read in place from the
+// mapped file. Opening one skips parsing and building the tree.
+// Delta coordinates store positions relative to the previous module as
+// variable length integers; they are only used if all coordinates are
+// integral, otherwise coordinates are stored as they are.
+bool isBinaryDesign(std::string fileName);
+void writeBinaryDesign(std::string fileName, const SlicingStructure& structure, const Netlist& netlist,
+                       bool deltaCoordinates = false);
+// Returns the structure, owned by the caller, and fills the modules and nets
+SlicingStructure* readBinaryDesign(std::string fileName, std::pair<std::vector<Module*>, Netlist>& design);
 
 #endif // INPUTREADER_H
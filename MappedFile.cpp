@@ -0,0 +1,99 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& fileName)
+    : m_data(0)
+    , m_size(0)
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(0)
+{
+    m_file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Cannot read the file " + fileName);
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        CloseHandle(m_file);
+        throw std::runtime_error("Cannot read the file " + fileName);
+    }
+    m_size = static_cast<std::size_t>(size.QuadPart);
+    if (m_size == 0) {
+        // Empty files cannot be mapped
+        return;
+    }
+    m_mapping = CreateFileMappingA(m_file, 0, PAGE_READONLY, 0, 0, 0);
+    if (m_mapping != 0) {
+        m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (m_data == 0) {
+        if (m_mapping != 0) {
+            CloseHandle(m_mapping);
+        }
+        CloseHandle(m_file);
+        throw std::runtime_error("Cannot map the file " + fileName);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != 0) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != 0) {
+        CloseHandle(m_mapping);
+    }
+    CloseHandle(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& fileName)
+    : m_data(0)
+    , m_size(0)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot read the file " + fileName);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read the file " + fileName);
+    }
+    m_size = static_cast<std::size_t>(info.st_size);
+    if (m_size == 0) {
+        // Empty files cannot be mapped
+        close(fd);
+        return;
+    }
+    void* data = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid without the descriptor
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map the file " + fileName);
+    }
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != 0) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory, so that large inputs
+// are parsed in place without copying them into streams first
+class MappedFile
+{
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    explicit MappedFile(const std::string& fileName);
+    ~MappedFile();
+
+    // Not terminated by zero; 0 for an empty file
+    const char* data() const;
+    std::size_t size() const;
+
+private:
+    MappedFile(const MappedFile& );
+    MappedFile& operator = (const MappedFile& );
+
+    const char* m_data;
+    std::size_t m_size;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#endif
+};
+
+inline const char* MappedFile::data() const
+{
+    return m_data;
+}
+
+inline std::size_t MappedFile::size() const
+{
+    return m_size;
+}
+
+#endif
@@ -8,7 +8,7 @@ Module::Block::Block(double w, double h, std::string n)
 }
 
 Module::Module(double x_, double y_, double width_, double height_, std::string name_, Block* b)
-    : rect(Rectangle(x_, y_, width_, height_))
+    : rect(snapToDatabaseUnits(x_, y_, width_, height_))
     , name(name_)
     , block(b)
 {
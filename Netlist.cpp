@@ -0,0 +1,105 @@
+#include "Netlist.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+bool byNet(const Netlist::Pin& a, const Netlist::Pin& b)
+{
+    if (a.second != b.second) {
+        return a.second < b.second;
+    }
+    return a.first < b.first;
+}
+
+}
+
+Netlist::Netlist()
+    : m_netOffsets(1, 0)
+    , m_moduleOffsets(1, 0)
+{
+}
+
+Netlist::Netlist(std::size_t moduleCount, std::vector<Pin> pins)
+    : m_netOffsets(1, 0)
+    , m_moduleOffsets(moduleCount + 1, 0)
+{
+    std::sort(pins.begin(), pins.end(), byNet);
+    pins.erase(std::unique(pins.begin(), pins.end()), pins.end());
+
+    // Renumber the nets in the order of their ids, pins are already grouped
+    // by net
+    std::vector<Pin>::iterator pin;
+    for (pin = pins.begin(); pin != pins.end(); ++pin) {
+        if (m_netIds.empty() || m_netIds.back() != pin->second) {
+            m_netIds.push_back(pin->second);
+        }
+        pin->second = static_cast<Id>(m_netIds.size() - 1);
+    }
+
+    // Nets to modules
+    const std::size_t netCount = m_netIds.size();
+    m_netOffsets.assign(netCount + 1, 0);
+    m_netModules.reserve(pins.size());
+    std::vector<Pin>::const_iterator it;
+    for (it = pins.begin(); it != pins.end(); ++it) {
+        assert(it->first < moduleCount);
+        ++m_netOffsets[it->second + 1];
+        ++m_moduleOffsets[it->first + 1];
+        m_netModules.push_back(it->first);
+    }
+    for (std::size_t i = 0; i < netCount; ++i) {
+        m_netOffsets[i + 1] += m_netOffsets[i];
+    }
+    for (std::size_t i = 0; i < moduleCount; ++i) {
+        m_moduleOffsets[i + 1] += m_moduleOffsets[i];
+    }
+
+    // Modules to nets: scattering pins in net order keeps nets sorted
+    m_moduleNets.resize(pins.size());
+    std::vector<std::size_t> next(m_moduleOffsets.begin(), m_moduleOffsets.end() - 1);
+    for (it = pins.begin(); it != pins.end(); ++it) {
+        m_moduleNets[next[it->first]++] = it->second;
+    }
+}
+
+std::size_t Netlist::moduleCount() const
+{
+    return m_moduleOffsets.size() - 1;
+}
+
+std::size_t Netlist::netCount() const
+{
+    return m_netOffsets.size() - 1;
+}
+
+std::size_t Netlist::pinCount() const
+{
+    return m_netModules.size();
+}
+
+Netlist::Id Netlist::netId(Id net) const
+{
+    return m_netIds[net];
+}
+
+const Netlist::Id* Netlist::netModulesBegin(Id net) const
+{
+    return m_netModules.data() + m_netOffsets[net];
+}
+
+const Netlist::Id* Netlist::netModulesEnd(Id net) const
+{
+    return m_netModules.data() + m_netOffsets[net + 1];
+}
+
+const Netlist::Id* Netlist::moduleNetsBegin(Id module) const
+{
+    return m_moduleNets.data() + m_moduleOffsets[module];
+}
+
+const Netlist::Id* Netlist::moduleNetsEnd(Id module) const
+{
+    return m_moduleNets.data() + m_moduleOffsets[module + 1];
+}
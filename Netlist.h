@@ -0,0 +1,43 @@
+#ifndef NETLIST_H
+#define NETLIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Assignment of modules to nets, stored in compressed sparse row form in
+// both directions. Modules are referred to by their position in the list of
+// blocks, which is also the order of leaves in a SlicingStructure.
+// Nets are numbered 0..netCount()-1 in the order of the ids they were given,
+// so unused ids take no space; netId gives back the id of a net.
+class Netlist
+{
+public:
+    typedef std::uint32_t Id;
+    typedef std::pair<Id, Id> Pin; // module and net
+
+    Netlist();     // constructs a netlist without nets
+    Netlist(std::size_t moduleCount, std::vector<Pin> pins); // repeated pins are ignored
+
+    std::size_t moduleCount() const;
+    std::size_t netCount() const;
+    std::size_t pinCount() const;
+
+    Id netId(Id net) const;
+
+    // Modules of a net and nets of a module, both in ascending order
+    const Id* netModulesBegin(Id net) const;
+    const Id* netModulesEnd(Id net) const;
+    const Id* moduleNetsBegin(Id module) const;
+    const Id* moduleNetsEnd(Id module) const;
+
+private:
+    std::vector<Id> m_netIds;
+    std::vector<std::size_t> m_netOffsets;
+    std::vector<Id> m_netModules;
+    std::vector<std::size_t> m_moduleOffsets;
+    std::vector<Id> m_moduleNets;
+};
+
+#endif
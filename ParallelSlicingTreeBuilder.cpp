@@ -0,0 +1,332 @@
+#include "ParallelSlicingTreeBuilder.h"
+
+#include "Progress.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+// Number of nested splits in a row that leave almost all leaves in one part.
+// Such splits cost a pass over the region but give no parallelism.
+const unsigned maxUnbalancedSplits = 4;
+
+// Node touching a cut line, with its extent along the line
+struct CutNode
+{
+    Coordinate from;
+    Coordinate to;
+    FloorplanArena::Index node;
+
+    bool operator < (const CutNode& other) const
+    {
+        if (from != other.from) {
+            return from < other.from;
+        }
+        return to < other.to;
+    }
+};
+
+}
+
+ParallelSlicingTreeBuilder::ParallelSlicingTreeBuilder(FloorplanArena& arena, ThreadPool& pool, std::size_t grainSize)
+    : m_arena(arena)
+    , m_pool(pool)
+    , m_grainSize(grainSize)
+    , m_rounds(0)
+    , m_progress(0)
+{
+}
+
+void ParallelSlicingTreeBuilder::setProgress(Progress* progress)
+{
+    m_progress = progress;
+}
+
+ParallelSlicingTreeBuilder::Index ParallelSlicingTreeBuilder::build(const std::vector<Index>& leaves)
+{
+    if (leaves.empty()) {
+        return FloorplanArena::null;
+    }
+    if (m_pool.size() == 1) {
+        // Splitting only pays off when parts run concurrently
+        SlicingTreeBuilder builder(m_arena);
+        builder.setProgress(m_progress);
+        return builder.build(leaves);
+    }
+
+    Region whole;
+    whole.leaves = leaves;
+    whole.firstSlot = m_arena.reserveFloorplans(leaves.size() - 1);
+    whole.root = FloorplanArena::null;
+
+    MergeRounds rounds(m_arena.leafCount(), m_arena.floorplanCount());
+    m_rounds = &rounds;
+    try {
+        buildRegion(whole, 0);
+    } catch (...) {
+        m_rounds = 0;
+        throw;
+    }
+    m_rounds = 0;
+    return whole.root;
+}
+
+void ParallelSlicingTreeBuilder::buildRegion(Region& region, unsigned unbalancedSplits)
+{
+    // Splitting reports nothing, but large regions take a while to split
+    if (0 != m_progress) {
+        m_progress->check();
+    }
+    if (region.leaves.size() < m_grainSize || region.leaves.size() == 1) {
+        buildSerially(region);
+        return;
+    }
+
+    Rectangle box = boundingBox(region.leaves);
+    std::vector<Coordinate> hCuts = findCuts(region.leaves, box, Floorplan::H);
+    std::vector<Coordinate> vCuts = findCuts(region.leaves, box, Floorplan::V);
+    if (hCuts.empty() == vCuts.empty()) {
+        // Either not a guillotine cut at this level, or a grid, where the
+        // serial construction may merge along either direction first
+        buildSerially(region);
+        return;
+    }
+    Floorplan::Type type = hCuts.empty() ? Floorplan::V : Floorplan::H;
+    const std::vector<Coordinate>& cuts = hCuts.empty() ? vCuts : hCuts;
+
+    // Distribute leaves between the parts lying between cut lines
+    std::vector<Region> parts(cuts.size() + 1);
+    std::vector<Index>::const_iterator it;
+    for (it = region.leaves.begin(); it != region.leaves.end(); ++it) {
+        const Rectangle& rect = m_arena.node(*it)->rect;
+        Coordinate position = (type == Floorplan::H) ? rect.bottom() : rect.left();
+        std::size_t part = std::upper_bound(cuts.begin(), cuts.end(), position) - cuts.begin();
+        parts[part].leaves.push_back(*it);
+    }
+
+    std::size_t largest = 0;
+    Index slot = region.firstSlot;
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        largest = std::max(largest, parts[i].leaves.size());
+        parts[i].firstSlot = slot;
+        parts[i].root = FloorplanArena::null;
+        slot += static_cast<Index>(parts[i].leaves.size() - 1);
+    }
+    if (8 * largest > 7 * region.leaves.size()) {
+        ++unbalancedSplits;
+        if (unbalancedSplits > maxUnbalancedSplits) {
+            buildSerially(region);
+            return;
+        }
+    } else {
+        unbalancedSplits = 0;
+    }
+
+    try {
+        ThreadPool::TaskGroup group(m_pool);
+        for (std::size_t i = 0; i < parts.size(); ++i) {
+            Region* part = &parts[i];
+            group.run([this, part, unbalancedSplits] { buildRegion(*part, unbalancedSplits); });
+        }
+        group.wait();
+    } catch (const std::runtime_error& ) {
+        // A part can not be merged on its own, but the serial construction
+        // may still succeed by merging across the cut
+        buildSerially(region);
+        return;
+    }
+
+    for (std::size_t i = 0; i + 1 < parts.size(); ++i) {
+        if (mergesAcrossCut(parts[i], parts[i + 1], cuts[i], type)) {
+            buildSerially(region);
+            return;
+        }
+    }
+
+    joinParts(region, parts, type);
+}
+
+void ParallelSlicingTreeBuilder::buildSerially(Region& region)
+{
+    SlicingTreeBuilder builder(m_arena);
+    builder.recordRounds(m_rounds);
+    builder.setProgress(m_progress);
+    builder.placeAt(region.firstSlot);
+    region.root = builder.build(region.leaves);
+}
+
+std::vector<Coordinate> ParallelSlicingTreeBuilder::findCuts(const std::vector<Index>& leaves, const Rectangle& box, Floorplan::Type type) const
+{
+    // Leaves do not overlap, so a line is a cut exactly when the leaves
+    // starting at it cover the whole box. Lengths are summed in double, as
+    // overlapping leaves of a wrong input could overflow integer ones.
+    std::unordered_map<Coordinate, double> covered;
+    std::vector<Index>::const_iterator it;
+    for (it = leaves.begin(); it != leaves.end(); ++it) {
+        const Rectangle& rect = m_arena.node(*it)->rect;
+        if (type == Floorplan::H) {
+            if (rect.bottom() > box.bottom()) {
+                covered[rect.bottom()] += rect.width();
+            }
+        } else {
+            if (rect.left() > box.left()) {
+                covered[rect.left()] += rect.height();
+            }
+        }
+    }
+
+    double length = (type == Floorplan::H) ? box.width() : box.height();
+    std::vector<Coordinate> cuts;
+    std::unordered_map<Coordinate, double>::const_iterator cIt;
+    for (cIt = covered.begin(); cIt != covered.end(); ++cIt) {
+        if (cIt->second == length) {
+            cuts.push_back(cIt->first);
+        }
+    }
+    std::sort(cuts.begin(), cuts.end());
+    return cuts;
+}
+
+bool ParallelSlicingTreeBuilder::mergesAcrossCut(const Region& lower, const Region& upper, Coordinate cut, Floorplan::Type type) const
+{
+    // Collect the nodes of both parts which touch the cut line
+    std::vector<CutNode> below;
+    std::vector<CutNode> above;
+    const Region* regions[2] = {&lower, &upper};
+    for (int side = 0; side < 2; ++side) {
+        const Region& region = *regions[side];
+        std::vector<Index> nodes(region.leaves);
+        for (std::size_t i = 0; i + 1 < region.leaves.size(); ++i) {
+            nodes.push_back(region.firstSlot + static_cast<Index>(i));
+        }
+        std::vector<Index>::const_iterator it;
+        for (it = nodes.begin(); it != nodes.end(); ++it) {
+            const Rectangle& rect = m_arena.node(*it)->rect;
+            CutNode c;
+            c.node = *it;
+            Coordinate edge;
+            if (type == Floorplan::H) {
+                c.from = rect.left();
+                c.to = rect.right();
+                edge = (side == 0) ? rect.top() : rect.bottom();
+            } else {
+                c.from = rect.bottom();
+                c.to = rect.top();
+                edge = (side == 0) ? rect.right() : rect.left();
+            }
+            if (edge == cut) {
+                (side == 0 ? below : above).push_back(c);
+            }
+        }
+    }
+    std::sort(below.begin(), below.end());
+    std::sort(above.begin(), above.end());
+
+    // Siblings across the cut have the same extent along it. They are
+    // merged if both exist at the start of a round of the cut's kind.
+    int parity = (type == Floorplan::H) ? 0 : 1;
+    std::vector<CutNode>::const_iterator b = below.begin();
+    std::vector<CutNode>::const_iterator a = above.begin();
+    while (b != below.end() && a != above.end()) {
+        if (*b < *a) {
+            ++b;
+        } else if (*a < *b) {
+            ++a;
+        } else {
+            std::vector<CutNode>::const_iterator aEnd = a;
+            while (aEnd != above.end() && !(*b < *aEnd)) {
+                ++aEnd;
+            }
+            std::vector<CutNode>::const_iterator bEnd = b;
+            while (bEnd != below.end() && !(*a < *bEnd)) {
+                ++bEnd;
+            }
+            for (std::vector<CutNode>::const_iterator i = b; i != bEnd; ++i) {
+                for (std::vector<CutNode>::const_iterator j = a; j != aEnd; ++j) {
+                    if (i->node == lower.root && j->node == upper.root) {
+                        continue;
+                    }
+                    int first = std::max(m_rounds->created(i->node), m_rounds->created(j->node)) + 1;
+                    int last = std::min(m_rounds->merged(i->node), m_rounds->merged(j->node));
+                    int round = ((first - parity) % 2 == 0) ? first : first + 1;
+                    if (round <= last) {
+                        return true;
+                    }
+                }
+            }
+            b = bEnd;
+            a = aEnd;
+        }
+    }
+    return false;
+}
+
+void ParallelSlicingTreeBuilder::joinParts(Region& region, std::vector<Region>& parts, Floorplan::Type type)
+{
+    // Replay the rounds of the serial construction on the roots of the
+    // parts: in every round of the cut's kind, each run of neighbouring
+    // roots which already exist is merged into a left-deep chain
+    struct Segment
+    {
+        Index node;
+        int created;
+    };
+
+    std::vector<Segment> segments;
+    Index slot = region.firstSlot;
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        Segment segment;
+        segment.node = parts[i].root;
+        segment.created = m_rounds->created(parts[i].root);
+        segments.push_back(segment);
+        slot += static_cast<Index>(parts[i].leaves.size() - 1);
+    }
+
+    int round = (type == Floorplan::H) ? 0 : 1;
+    while (segments.size() > 1) {
+        std::vector<Segment> next;
+        std::size_t i = 0;
+        while (i < segments.size()) {
+            Segment current = segments[i++];
+            if (current.created < round) {
+                while (i < segments.size() && segments[i].created < round) {
+                    Index merged = slot++;
+                    m_arena.createFloorplanAt(merged, current.node, segments[i].node, type);
+                    m_rounds->setCreated(merged, round);
+                    m_rounds->setMerged(current.node, round);
+                    m_rounds->setMerged(segments[i].node, round);
+                    current.node = merged;
+                    current.created = round;
+                    ++i;
+                }
+            }
+            next.push_back(current);
+        }
+        segments.swap(next);
+        round += 2;
+    }
+
+    assert(slot == region.firstSlot + region.leaves.size() - 1);
+    region.root = segments.front().node;
+}
+
+Rectangle ParallelSlicingTreeBuilder::boundingBox(const std::vector<Index>& leaves) const
+{
+    const Rectangle& first = m_arena.node(leaves.front())->rect;
+    Coordinate left = first.left();
+    Coordinate right = first.right();
+    Coordinate bottom = first.bottom();
+    Coordinate top = first.top();
+    std::vector<Index>::const_iterator it;
+    for (it = leaves.begin(); it != leaves.end(); ++it) {
+        const Rectangle& rect = m_arena.node(*it)->rect;
+        left = std::min(left, rect.left());
+        right = std::max(right, rect.right());
+        bottom = std::min(bottom, rect.bottom());
+        top = std::max(top, rect.top());
+    }
+    return Rectangle(left, bottom, right - left, top - bottom);
+}
@@ -0,0 +1,67 @@
+#ifndef PARALLEL_SLICING_TREE_BUILDER_H
+#define PARALLEL_SLICING_TREE_BUILDER_H
+
+#include "FloorplanArena.h"
+#include "SlicingTreeBuilder.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <vector>
+
+// Builds the same slicing tree as SlicingTreeBuilder using a thread pool.
+// A region is split top-down along all of its full-length cut lines of one
+// direction, the parts are built concurrently and their roots are joined
+// into H or V floorplans.
+// The serial construction merges in global rounds, so a part of the tree
+// may also take nodes from both sides of a cut line. To stay equivalent, the
+// rounds of all merges are recorded and each cut is checked for siblings
+// which the serial construction would have merged across it; such regions,
+// as well as regions with cuts in both directions, are built serially.
+class ParallelSlicingTreeBuilder
+{
+public:
+    typedef FloorplanArena::Index Index;
+
+    // Regions with fewer leaves than grainSize are built serially
+    ParallelSlicingTreeBuilder(FloorplanArena& arena, ThreadPool& pool, std::size_t grainSize = 4096);
+
+    // Reports merges to the progress, which may cancel the build
+    void setProgress(Progress* progress);
+
+    // Returns the root of the tree, or FloorplanArena::null for no leaves.
+    // Throws std::runtime_error if the leaves do not form a slicing floorplan,
+    // and Cancelled if the progress was cancelled.
+    Index build(const std::vector<Index>& leaves);
+
+private:
+    struct Region
+    {
+        std::vector<Index> leaves;
+        Index firstSlot;
+        Index root;
+    };
+
+    void buildRegion(Region& region, unsigned unbalancedSplits);
+    void buildSerially(Region& region);
+
+    // Returns the coordinates of the full-length cut lines inside the
+    // bounding box, in ascending order
+    std::vector<Coordinate> findCuts(const std::vector<Index>& leaves, const Rectangle& box, Floorplan::Type type) const;
+
+    // Tells whether the serial construction would merge siblings lying on
+    // different sides of the cut between two neighbouring parts
+    bool mergesAcrossCut(const Region& lower, const Region& upper, Coordinate cut, Floorplan::Type type) const;
+
+    void joinParts(Region& region, std::vector<Region>& parts, Floorplan::Type type);
+
+    Rectangle boundingBox(const std::vector<Index>& leaves) const;
+
+private:
+    FloorplanArena& m_arena;
+    ThreadPool& m_pool;
+    std::size_t m_grainSize;
+    MergeRounds* m_rounds;
+    Progress* m_progress;
+};
+
+#endif
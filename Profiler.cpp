@@ -0,0 +1,231 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+
+namespace {
+
+struct Event
+{
+    const char* name;
+    unsigned thread;
+    std::int64_t start;     // nanoseconds since the reset
+    std::int64_t duration;
+};
+
+// Slices kept for the trace; phases are still summed beyond that
+const std::size_t maxEvents = 1 << 20;
+
+std::mutex mutex;
+Profiler::Clock::time_point epoch = Profiler::Clock::now();
+std::vector<Event> events;
+std::size_t droppedEvents = 0;
+std::vector<Profiler::Phase> phaseList;
+std::map<std::string, std::size_t> phaseIndex;
+std::atomic<std::uint64_t> counters[Profiler::CounterCount];
+
+std::atomic<unsigned> nextThread(0);
+
+unsigned threadNumber()
+{
+    thread_local unsigned number = nextThread++;
+    return number;
+}
+
+std::int64_t nanoseconds(Profiler::Clock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+std::string quoted(const std::string& text)
+{
+    std::string result = "\"";
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '"' || text[i] == '\\') {
+            result += '\\';
+        }
+        result += text[i];
+    }
+    return result + "\"";
+}
+
+std::string number(double value)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+}
+
+void writeCounters(std::ostream& out)
+{
+    for (int c = 0; c < Profiler::CounterCount; ++c) {
+        const Profiler::Counter counter = static_cast<Profiler::Counter>(c);
+        out << (c == 0 ? "" : ", ") << quoted(Profiler::counterName(counter)) << ": " << Profiler::counter(counter);
+    }
+}
+
+template <typename Write>
+void writeFile(const std::string& fileName, const Write& write)
+{
+    std::ofstream outFile(fileName.c_str());
+    if (outFile.fail()) {
+        throw std::runtime_error("Cannot write to file " + fileName);
+    }
+    write(outFile);
+    outFile.close();
+    if (outFile.fail()) {
+        throw std::runtime_error("Cannot write to file " + fileName);
+    }
+}
+
+}
+
+std::atomic<bool> Profiler::s_enabled(false);
+
+void Profiler::setEnabled(bool enabled)
+{
+    if (enabled && !isEnabled()) {
+        reset();
+    }
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    epoch = Clock::now();
+    events.clear();
+    droppedEvents = 0;
+    phaseList.clear();
+    phaseIndex.clear();
+    for (int c = 0; c < CounterCount; ++c) {
+        counters[c].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Profiler::add(Counter counter, std::uint64_t n)
+{
+    counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+std::uint64_t Profiler::counter(Counter counter)
+{
+    return counters[counter].load(std::memory_order_relaxed);
+}
+
+const char* Profiler::counterName(Counter counter)
+{
+    switch (counter) {
+    case NodesVisited:
+        return "nodes visited";
+    case SwapsApplied:
+        return "swaps applied";
+    case MergeRounds:
+        return "merge rounds";
+    case Allocations:
+        return "allocations";
+    default:
+        return "";
+    }
+}
+
+void Profiler::record(const char* phase, Clock::time_point start, Clock::time_point end)
+{
+    const unsigned thread = threadNumber();
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::int64_t duration = nanoseconds(end - start);
+
+    std::map<std::string, std::size_t>::iterator it = phaseIndex.find(phase);
+    if (it == phaseIndex.end()) {
+        Phase p;
+        p.name = phase;
+        p.calls = 0;
+        p.milliseconds = 0;
+        it = phaseIndex.insert(std::make_pair(p.name, phaseList.size())).first;
+        phaseList.push_back(p);
+    }
+    ++phaseList[it->second].calls;
+    phaseList[it->second].milliseconds += duration / 1e6;
+
+    if (events.size() == maxEvents) {
+        ++droppedEvents;
+        return;
+    }
+    Event event;
+    event.name = phase;
+    event.thread = thread;
+    event.start = start < epoch ? 0 : nanoseconds(start - epoch);
+    event.duration = duration;
+    events.push_back(event);
+}
+
+std::vector<Profiler::Phase> Profiler::phases()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return phaseList;
+}
+
+std::string Profiler::summary()
+{
+    std::string result;
+    const std::vector<Phase> list = phases();
+    for (std::size_t i = 0; i < list.size(); ++i) {
+        result += (i == 0 ? "" : ", ") + list[i].name + " " + number(list[i].milliseconds) + " ms";
+        if (list[i].calls > 1) {
+            result += " (" + std::to_string(list[i].calls) + "x)";
+        }
+    }
+    for (int c = 0; c < CounterCount; ++c) {
+        const Counter counter = static_cast<Counter>(c);
+        if (Profiler::counter(counter) != 0) {
+            result += (result.empty() ? "" : ", ") + std::to_string(Profiler::counter(counter)) + " " + counterName(counter);
+        }
+    }
+    return result;
+}
+
+void Profiler::writeJson(std::ostream& out)
+{
+    const std::vector<Phase> list = phases();
+    out << "{\n  \"phases\": [";
+    for (std::size_t i = 0; i < list.size(); ++i) {
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": " << quoted(list[i].name)
+            << ", \"calls\": " << list[i].calls
+            << ", \"ms\": " << number(list[i].milliseconds) << "}";
+    }
+    out << "\n  ],\n  \"counters\": {";
+    writeCounters(out);
+    out << "}\n}\n";
+}
+
+void Profiler::writeJson(std::string fileName)
+{
+    writeFile(fileName, [](std::ostream& out) { writeJson(out); });
+}
+
+void Profiler::writeTrace(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    std::int64_t end = 0;
+    std::vector<Event>::const_iterator it;
+    for (it = events.begin(); it != events.end(); ++it) {
+        // Times of trace events are in microseconds
+        out << "{\"name\": " << quoted(it->name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << it->thread
+            << ", \"ts\": " << number(it->start / 1e3) << ", \"dur\": " << number(it->duration / 1e3) << "},\n";
+        end = std::max(end, it->start + it->duration);
+    }
+    out << "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << number(end / 1e3) << ", \"args\": {";
+    writeCounters(out);
+    out << "}}\n], \"otherData\": {\"dropped events\": " << droppedEvents << "}}\n";
+}
+
+void Profiler::writeTrace(std::string fileName)
+{
+    writeFile(fileName, [](std::ostream& out) { writeTrace(out); });
+}
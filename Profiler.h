@@ -0,0 +1,104 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Phase timers and operation counters of the whole process. Disabled by
+// default, when a timer or a counter costs a single relaxed load of a flag.
+// Phases and counters are collected from all threads until the next reset.
+class Profiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Counter {
+        NodesVisited,       // by the passes over the tree
+        SwapsApplied,
+        MergeRounds,        // of the slicing tree builders
+        Allocations,        // chunks of nodes allocated or copied on write
+        CounterCount
+    };
+
+    struct Phase
+    {
+        std::string name;
+        std::size_t calls;
+        double milliseconds;    // summed over threads, so may exceed wall time
+    };
+
+    static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Enabling also resets, so that timings start at the same point
+    static void setEnabled(bool enabled);
+    static void reset();
+
+    static void count(Counter counter, std::uint64_t n = 1)
+    {
+        if (isEnabled()) {
+            add(counter, n);
+        }
+    }
+
+    static std::uint64_t counter(Counter counter);
+    static const char* counterName(Counter counter);
+
+    // In the order the phases were first entered
+    static std::vector<Phase> phases();
+
+    // One line of phases and counters, e.g. for a status bar
+    static std::string summary();
+
+    // Phases and counters as a JSON object, or as a Chrome trace event file
+    // with a slice for every timed scope. Throw std::runtime_error if the
+    // file cannot be written.
+    static void writeJson(std::ostream& out);
+    static void writeJson(std::string fileName);
+    static void writeTrace(std::ostream& out);
+    static void writeTrace(std::string fileName);
+
+    static void record(const char* phase, Clock::time_point start, Clock::time_point end);
+
+private:
+    static void add(Counter counter, std::uint64_t n);
+
+    static std::atomic<bool> s_enabled;
+};
+
+// Records the time from construction to destruction as a phase. The name
+// must outlive the profile, so use string literals.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const char* phase)
+        : m_phase(Profiler::isEnabled() ? phase : 0)
+    {
+        if (m_phase != 0) {
+            m_start = Profiler::Clock::now();
+        }
+    }
+
+    ~ScopedTimer()
+    {
+        if (m_phase != 0) {
+            Profiler::record(m_phase, m_start, Profiler::Clock::now());
+        }
+    }
+
+private:
+    ScopedTimer(const ScopedTimer& );
+    ScopedTimer& operator = (const ScopedTimer& );
+
+    const char* m_phase;
+    Profiler::Clock::time_point m_start;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "Progress.h"
+
+const char* Cancelled::what() const noexcept
+{
+    return "Operation cancelled";
+}
+
+Progress::Progress()
+    : m_cancelled(false)
+    , m_phase("")
+    , m_total(0)
+    , m_done(0)
+{
+}
+
+void Progress::start(const char* phase, std::uint64_t total)
+{
+    check();
+    m_phase = phase;
+    m_total = total;
+    m_done = 0;
+}
+
+void Progress::advance(std::uint64_t done)
+{
+    m_done.fetch_add(done, std::memory_order_relaxed);
+    check();
+}
+
+void Progress::check() const
+{
+    if (m_cancelled.load(std::memory_order_relaxed)) {
+        throw Cancelled();
+    }
+}
+
+void Progress::cancel()
+{
+    m_cancelled = true;
+}
+
+bool Progress::isCancelled() const
+{
+    return m_cancelled;
+}
+
+const char* Progress::phase() const
+{
+    return m_phase;
+}
+
+std::uint64_t Progress::total() const
+{
+    return m_total;
+}
+
+std::uint64_t Progress::done() const
+{
+    return m_done.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,52 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+
+// Thrown at a checkpoint of an operation whose progress was cancelled.
+// Not a std::runtime_error, so that handlers of wrong input, e.g. the
+// fallbacks of ParallelSlicingTreeBuilder, let it through.
+class Cancelled
+    : public std::exception
+{
+public:
+    const char* what() const noexcept;
+};
+
+// Progress of a long operation, reported from the thread running it and
+// read from another one, which may also cancel the operation.
+// An operation is made of phases of a known number of units of work, e.g.
+// merges or visited nodes; advance is also the checkpoint where a cancelled
+// operation throws Cancelled. Threads of a pool may report at once.
+class Progress
+{
+public:
+    Progress();
+
+    // Phase names must outlive the progress, so use string literals
+    void start(const char* phase, std::uint64_t total);
+
+    // Throws Cancelled if cancel was called
+    void advance(std::uint64_t done = 1);
+    void check() const;
+
+    void cancel();
+    bool isCancelled() const;
+
+    const char* phase() const;
+    std::uint64_t total() const;    // 0 if unknown
+    std::uint64_t done() const;     // may exceed total if a phase redoes work
+
+private:
+    Progress(const Progress& );
+    Progress& operator = (const Progress& );
+
+    std::atomic<bool> m_cancelled;
+    std::atomic<const char*> m_phase;
+    std::atomic<std::uint64_t> m_total;
+    std::atomic<std::uint64_t> m_done;
+};
+
+#endif
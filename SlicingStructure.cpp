@@ -1,7 +1,16 @@
 #include "SlicingStructure.h"
-
+#include "SlicingTreeBuilder.h"
+#include "ParallelSlicingTreeBuilder.h"
+#include "Profiler.h"
+#include "Progress.h"
+#include "SwapEvaluation.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
 #include <cassert>
-#include <iostream>
+#include <cmath>
+#include <iterator>
+#include <queue>
 
 namespace utils {
 
@@ -27,565 +36,1435 @@ Point mergedCenterOfGravity(const BaseFloorplan* left, const BaseFloorplan* righ
     return centerOfGravity;
 }
 
-Point swappedCenterOfGravity(const Floorplan* f)
+bool swapCondition(const Point& center, const Point& swappedCenter, const Point& target)
 {
-    // Create the left child of swapped floorplan, using the right child of original one
-    BaseFloorplan left(f->right->rect, f->right->centerOfGravity, f->right->weight);
-
-    // Create the right child of swapped floorplan, using the left child of original one
-    BaseFloorplan right(f->left->rect, f->left->centerOfGravity, f->left->weight);
-
-    Floorplan swappedFloorplan(&left, &right, f->type);
+    return (center.distance(target) > swappedCenter.distance(target));
+}
 
-    // Shift coordinates of swapped children
-    swappedFloorplan.swapCoordinates();
+void setLeafWeight(LeafFloorplan* f, const std::set<Module*>& moduleNets)
+{
+    if (moduleNets.find(f->module) != moduleNets.end()) {
+        // In double, integer coordinates would overflow or round down
+        f->centerOfGravity = Point((static_cast<double>(f->rect.right()) + f->rect.left()) / 2,
+                                    (static_cast<double>(f->rect.top()) + f->rect.bottom()) / 2);
+        f->weight = static_cast<double>(f->rect.width()) * f->rect.height();
+    } else {
+        f->centerOfGravity = Point::undefined;
+        f->weight = 0;
+    }
+}
 
-    return mergedCenterOfGravity(&left, &right);
+Point origin(const BaseFloorplan* f)
+{
+    return Point(f->rect.x(), f->rect.y());
 }
 
-bool swapCondition(const Point& center, const Point& swappedCenter, const Point& target)
+// Offset of the right child from the origin of its floorplan
+Point rightOffset(const BaseFloorplan* left, Floorplan::Type type)
 {
-    return (center.distance(target) > swappedCenter.distance(target));
+    if (type == Floorplan::V) {
+        return Point(left->rect.width(), 0);
+    }
+    return Point(0, left->rect.height());
 }
 
+// Counts the nodes visited by a pass for the profiler and reports them to
+// the progress in steps, which are also the checkpoints for cancelling
+class VisitCounter
+{
+public:
+    explicit VisitCounter(Progress* progress)
+        : m_progress(progress)
+        , m_visited(0)
+        , m_reported(0)
+    {
+    }
+
+    void visit(std::uint64_t nodes = 1)
+    {
+        m_visited += nodes;
+        if (0 != m_progress && m_visited - m_reported >= step) {
+            report();
+        }
+    }
+
+    void finish()
+    {
+        Profiler::count(Profiler::NodesVisited, m_visited);
+        if (0 != m_progress) {
+            report();
+        }
+    }
+
+private:
+    static const std::uint64_t step = 4096;
+
+    void report()
+    {
+        const std::uint64_t nodes = m_visited - m_reported;
+        m_reported = m_visited;
+        m_progress->advance(nodes);
+    }
+
+    Progress* m_progress;
+    std::uint64_t m_visited;
+    std::uint64_t m_reported;
+};
+
 }
 
-struct CompareX
+// Weight and center of gravity of one net in a subtree. The center is
+// relative to the origin of the subtree, so it stays valid when the
+// subtree is moved.
+struct SlicingStructure::NetTerm
 {
-    bool operator()(const BaseFloorplan* f1, const BaseFloorplan* f2) const
+    Netlist::Id net;
+    double weight;
+    Point center;
+};
+
+// Nets of every subtree, stored in one buffer
+class SlicingStructure::NetCenters
+{
+public:
+    NetCenters(const FloorplanArena& arena)
+        : m_leafRanges(arena.leafCount(), Range(0, 0))
+        , m_floorplanRanges(arena.floorplanCount(), Range(0, 0))
+    {
+    }
+
+    const NetTerm* begin(Index f) const
     {
-        return f1->rect.x() > f2->rect.x();
+        return m_terms.data() + range(f).first;
     }
+
+    const NetTerm* end(Index f) const
+    {
+        return m_terms.data() + range(f).second;
+    }
+
+    bool empty(Index f) const
+    {
+        return range(f).first == range(f).second;
+    }
+
+    void assign(Index f, const std::vector<NetTerm>& terms)
+    {
+        range(f) = Range(m_terms.size(), m_terms.size() + terms.size());
+        m_terms.insert(m_terms.end(), terms.begin(), terms.end());
+    }
+
+    // Swapping children changes centers, but not the nets of a subtree
+    void update(Index f, const std::vector<NetTerm>& terms)
+    {
+        assert(range(f).second - range(f).first == terms.size());
+        std::copy(terms.begin(), terms.end(), m_terms.begin() + range(f).first);
+    }
+
+    // Buffers for merging children
+    std::vector<NetTerm> merged;
+    std::vector<NetTerm> swapped;
+
+private:
+    typedef std::pair<std::size_t, std::size_t> Range;
+
+    Range& range(Index f)
+    {
+        if (FloorplanArena::isLeafIndex(f)) {
+            return m_leafRanges[f & ~FloorplanArena::leafBit];
+        }
+        return m_floorplanRanges[f];
+    }
+
+    const Range& range(Index f) const
+    {
+        return const_cast<NetCenters*>(this)->range(f);
+    }
+
+    std::vector<NetTerm> m_terms;
+    std::vector<Range> m_leafRanges;
+    std::vector<Range> m_floorplanRanges;
 };
 
-struct CompareY
+// Points the nets are moved to: either one point for all nets, or the
+// centers of the nets of another subtree
+class SlicingStructure::NetTargets
 {
-    bool operator()(const BaseFloorplan* f1, const BaseFloorplan* f2) const
+public:
+    NetTargets(const Point& target)
+        : m_target(target)
+        , m_common(true)
+    {
+    }
+
+    NetTargets(const NetCenters& nets, Index f, const Point& origin)
+        : m_common(false)
+    {
+        for (const NetTerm* it = nets.begin(f); it != nets.end(f); ++it) {
+            NetTerm term = *it;
+            term.center = Point(origin.x + term.center.x, origin.y + term.center.y);
+            m_targets.push_back(term);
+        }
+    }
+
+    // Returns 0 if the net has no target
+    const Point* find(Netlist::Id net) const
     {
-        return f1->rect.y() > f2->rect.y();
+        if (m_common) {
+            return &m_target;
+        }
+        std::size_t low = 0;
+        std::size_t high = m_targets.size();
+        while (low < high) {
+            std::size_t middle = (low + high) / 2;
+            if (m_targets[middle].net < net) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (low < m_targets.size() && m_targets[low].net == net) {
+            return &m_targets[low].center;
+        }
+        return 0;
     }
+
+    // Sum of distances from the centers of nets to their targets
+    double distance(const NetTerm* begin, const NetTerm* end, const Point& origin) const
+    {
+        double sum = 0;
+        for (const NetTerm* it = begin; it != end; ++it) {
+            const Point* target = find(it->net);
+            if (target != 0) {
+                sum += Point(origin.x + it->center.x, origin.y + it->center.y).distance(*target);
+            }
+        }
+        return sum;
+    }
+
+private:
+    Point m_target;
+    bool m_common;
+    std::vector<NetTerm> m_targets;
 };
 
 SlicingStructure::SlicingStructure()
-    : m_floorplan(0)
+    : m_root(FloorplanArena::null)
+    , m_coordinatesValid(true)
+    , m_compact(false)
+    , m_migrationValid(false)
+    , m_threadPool(0)
+    , m_grainSize(0)
+    , m_progress(0)
+{
+}
+
+SlicingStructure::SlicingStructure(const std::vector<Module*>& modules, Progress* progress)
+    : m_root(FloorplanArena::null)
+    , m_coordinatesValid(true)
+    , m_compact(false)
+    , m_migrationValid(false)
+    , m_threadPool(0)
+    , m_grainSize(0)
+    , m_progress(0)
+{
+    buildSlicingTree(modules, 0, progress);
+}
+
+SlicingStructure::SlicingStructure(const std::vector<Module*>& modules, ThreadPool& pool, Progress* progress)
+    : m_root(FloorplanArena::null)
+    , m_coordinatesValid(true)
+    , m_compact(false)
+    , m_migrationValid(false)
+    , m_threadPool(0)
+    , m_grainSize(0)
+    , m_progress(0)
 {
+    buildSlicingTree(modules, &pool, progress);
 }
 
-SlicingStructure::SlicingStructure(const std::vector<Module*>& modules)
+SlicingStructure::SlicingStructure(const std::vector<Module*>& modules, const FloorplanArena& arena, FloorplanArena::Index root)
+    : m_arena(arena)
+    , m_root(root)
+    , m_coordinatesValid(true)
+    , m_compact(false)
+    , m_migrationValid(false)
+    , m_threadPool(0)
+    , m_grainSize(0)
+    , m_progress(0)
 {
-    fillFloorplanMaps(modules);
-    //print();
-    buildSlicingTree();
+    assert(arena.leafCount() == modules.size());
+    std::shared_ptr<std::unordered_map<const Module*, Index> > leafOf =
+            std::make_shared<std::unordered_map<const Module*, Index> >();
+    leafOf->reserve(modules.size());
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        assert(arena.leaf(static_cast<Index>(i) | FloorplanArena::leafBit)->module == modules[i]);
+        (*leafOf)[modules[i]] = static_cast<Index>(i) | FloorplanArena::leafBit;
+    }
+    m_leaves = leafOf;
 }
 
 SlicingStructure::SlicingStructure(const SlicingStructure& other)
-    : m_floorplan(other.m_floorplan)
-    , m_xFlrp(other.m_xFlrp)
-    , m_yFlrp(other.m_yFlrp)
+    : m_arena(other.m_arena)
+    , m_root(other.m_root)
+    , m_leaves(other.m_leaves)
+    , m_coordinatesValid(other.m_coordinatesValid)
+    , m_compact(other.m_compact)
+    , m_migrationNet(other.m_migrationNet)
+    , m_migrationTarget(other.m_migrationTarget)
+    , m_migrationValid(other.m_migrationValid)
+    , m_threadPool(other.m_threadPool)
+    , m_grainSize(other.m_grainSize)
+    , m_progress(0)
+    , m_subtreeLeaves(other.m_subtreeLeaves)
 {
 
 }
 
-BaseFloorplan* SlicingStructure::floorplan() const
+SlicingStructure::~SlicingStructure()
 {
-    return m_floorplan;
 }
 
-void SlicingStructure::reduceDistnace(Module* module1, Module* module2)
+const BaseFloorplan* SlicingStructure::floorplan() const
 {
-    LeafFloorplan* f1 = new LeafFloorplan(module1);
-    LeafFloorplan* f2 = new LeafFloorplan(module2);
-    BaseFloorplan* root = lowestCommonAncestor(m_floorplan, f1, f2);
-    Floorplan* f = dynamic_cast<Floorplan*>(root);
-    assert(0 != f);
-    if (f->type == Floorplan::H) {
-        if (f1->rect.y() < f2->rect.y()) {
-            moveToSide(root, f1, SlicingStructure::TOP, f->type);
-            moveToSide(root, f2, SlicingStructure::BOTTOM, f->type);
-        } else if (f1->rect.y() > f2->rect.y()) {
-            moveToSide(root, f1, SlicingStructure::BOTTOM, f->type);
-            moveToSide(root, f2, SlicingStructure::TOP, f->type);
-        }
-        f->recalculateTree();
-        moveToSide(root, f1, SlicingStructure::RIGHT, Floorplan::V);
-        f->recalculateTree();
-        moveToSide(root, f2, SlicingStructure::RIGHT, Floorplan::V);
-        f->recalculateTree();
-        // reduce dist in vert dir
-    } else {
-        if (f1->rect.x() < f2->rect.x()) {
-            moveToSide(root, f1, SlicingStructure::RIGHT, f->type);
-            moveToSide(root, f2, SlicingStructure::LEFT, f->type);
-        } else if (f1->rect.x() > f2->rect.x()) {
-            moveToSide(root, f1, SlicingStructure::LEFT, f->type);
-            moveToSide(root, f2, SlicingStructure::RIGHT, f->type);
-        }
-        f->recalculateTree();
-        moveToSide(root, f1, SlicingStructure::BOTTOM, Floorplan::H);
-        f->recalculateTree();
-        moveToSide(root, f2, SlicingStructure::BOTTOM, Floorplan::H);
-        f->recalculateTree();
-        // reduce dist in horiz dir
-    }
-}
-
-void SlicingStructure::moveToSide(BaseFloorplan* root, LeafFloorplan* f, Destination dest, Floorplan::Type type)
-{
-    std::vector<Floorplan*> path;
-    bool found;
-    found = findPath(root, f, path);
-    assert(found);
-    std::vector<Floorplan*>::const_iterator it = path.begin();
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(root);
-    assert(0 != floorplan);
-    bool isRightChild = false;
-    if (((*it)->type == Floorplan::V && (*it)->rect.right() == f->rect.right()) ||
-        ((*it)->type == Floorplan::H && (*it)->rect.top() == f->rect.top())) {
-            isRightChild = true;
-    }
-    for (; it != path.end() - 1; ++it) {
-        if (type == (*it)->type) {
-            if (isRightChild && (dest == SlicingStructure::LEFT || dest == SlicingStructure::BOTTOM)) {
-                (*it)->swapChildren();
-            } else if (!isRightChild && (dest == SlicingStructure::RIGHT || dest == SlicingStructure::TOP)) {
-                (*it)->swapChildren();
+    if (m_root == FloorplanArena::null) {
+        return 0;
+    }
+    return m_arena.node(m_root);
+}
+
+const FloorplanArena& SlicingStructure::arena() const
+{
+    return m_arena;
+}
+
+FloorplanArena::Index SlicingStructure::root() const
+{
+    return m_root;
+}
+
+void SlicingStructure::balanceChains()
+{
+    ScopedTimer timer("balance chains");
+    m_migrationValid = false;
+    if (m_root == FloorplanArena::null || FloorplanArena::isLeafIndex(m_root)) {
+        return;
+    }
+    updateCoordinates();
+
+    // Chains are read without copying shared chunks, only rebuilt chains
+    // are copied
+    const FloorplanArena& arena = m_arena;
+
+    // Highest floorplans of chains which are still to be balanced
+    std::vector<Index> tops(1, m_root);
+    std::vector<Index> slots;
+    std::vector<Index> operands;
+    std::vector<Index> stack;
+    while (!tops.empty()) {
+        const Index top = tops.back();
+        tops.pop_back();
+        const Floorplan::Type type = arena.floorplan(top)->type;
+
+        // Collect the floorplans of the chain and, from left to right, the
+        // subtrees it joins
+        slots.clear();
+        operands.clear();
+        stack.assign(1, top);
+        while (!stack.empty()) {
+            const Index index = stack.back();
+            stack.pop_back();
+            const Floorplan* floorplan = arena.floorplan(index);
+            if (0 != floorplan && floorplan->type == type) {
+                slots.push_back(index);
+                stack.push_back(floorplan->right);
+                stack.push_back(floorplan->left);
+            } else {
+                operands.push_back(index);
+                if (0 != floorplan) {
+                    tops.push_back(index);
+                }
             }
         }
-        Floorplan* parent = *(it + 1);
-        if ((parent->type == Floorplan::V && parent->rect.right() == (*it)->rect.right()) ||
-            (parent->type == Floorplan::H && parent->rect.top() == (*it)->rect.top())) {
-            isRightChild = true;
+        if (operands.size() > 2) {
+            rebuildChain(top, type, slots, operands);
+        }
+    }
+
+    // Subtree sizes changed, and reused floorplans may precede their parents
+    m_compact = false;
+    if (m_threadPool != 0) {
+        countSubtreeLeaves();
+    } else {
+        m_subtreeLeaves.reset();
+    }
+}
+
+void SlicingStructure::rebuildChain(Index top, Floorplan::Type type, const std::vector<Index>& slots, std::vector<Index>& operands)
+{
+    assert(slots.front() == top && slots.size() + 1 == operands.size());
+    const Index parent = m_arena.node(top)->parent;
+    std::size_t next = 1;
+    while (operands.size() > 2) {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i + 1 < operands.size(); i += 2) {
+            const Index merged = slots[next++];
+            m_arena.createFloorplanAt(merged, operands[i], operands[i + 1], type);
+            operands[count++] = merged;
+        }
+        if (operands.size() % 2 != 0) {
+            operands[count++] = operands.back();
+        }
+        operands.resize(count);
+    }
+    m_arena.createFloorplanAt(top, operands[0], operands[1], type);
+    m_arena.node(top)->parent = parent;
+}
+
+void SlicingStructure::compact()
+{
+    ScopedTimer timer("compact");
+    m_migrationValid = false;
+    if (m_root == FloorplanArena::null || FloorplanArena::isLeafIndex(m_root)) {
+        m_compact = true;
+        return;
+    }
+
+    // Pre-order of the current tree
+    const FloorplanArena& arena = m_arena;
+    std::vector<Index> order;
+    order.reserve(arena.floorplanCount());
+    std::vector<Index> stack(1, m_root);
+    while (!stack.empty()) {
+        const Floorplan* floorplan = arena.floorplan(stack.back());
+        order.push_back(stack.back());
+        stack.pop_back();
+        if (!FloorplanArena::isLeafIndex(floorplan->right)) {
+            stack.push_back(floorplan->right);
+        }
+        if (!FloorplanArena::isLeafIndex(floorplan->left)) {
+            stack.push_back(floorplan->left);
+        }
+    }
+    assert(order.size() == m_arena.floorplanCount());
+
+    m_arena.reorderFloorplans(order);
+    m_root = 0;
+    countSubtreeLeaves();
+    m_compact = true;
+}
+
+void SlicingStructure::updateCoordinates() const
+{
+    if (m_coordinatesValid) {
+        return;
+    }
+    // Coordinates are a cache of the shape of the tree, so they are fixed
+    // even in a const structure, copying the chunks of shared nodes
+    FloorplanArena& arena = const_cast<FloorplanArena&>(m_arena);
+    Floorplan* root = (m_root == FloorplanArena::null) ? 0 : arena.floorplan(m_root);
+    if (0 != root) {
+        root->recalculateTree(arena);
+    }
+    m_coordinatesValid = true;
+}
+
+void SlicingStructure::setThreadPool(ThreadPool* pool, std::size_t grainSize)
+{
+    m_threadPool = pool;
+    m_grainSize = grainSize;
+    if (pool != 0 && (!m_subtreeLeaves || m_subtreeLeaves->size() != m_arena.floorplanCount())) {
+        countSubtreeLeaves();
+    }
+}
+
+void SlicingStructure::setProgress(Progress* progress)
+{
+    m_progress = progress;
+}
+
+void SlicingStructure::startProgress(const char* phase, std::uint64_t total)
+{
+    if (0 != m_progress) {
+        m_progress->start(phase, total);
+    }
+}
+
+void SlicingStructure::reduceDistnace(Module* module1, Module* module2)
+{
+    reduceDistances(std::vector<ModulePair>(1, ModulePair(module1, module2)));
+}
+
+void SlicingStructure::reduceDistances(const std::vector<ModulePair>& pairs)
+{
+    // Swaps only mark floorplans, positions of leaves are derived from the
+    // highest marked ancestor, so no subtree is recalculated here
+    ScopedTimer timer("reduce distance");
+    startProgress("Reducing distances", pairs.size());
+    m_migrationValid = false;
+    if (!pairs.empty()) {
+        m_coordinatesValid = false;
+    }
+
+    std::vector<ModulePair>::const_iterator it;
+    for (it = pairs.begin(); it != pairs.end(); ++it) {
+        Index f1 = leafOf(it->first);
+        Index f2 = leafOf(it->second);
+        Index root = lowestCommonAncestor(f1, f2);
+        Floorplan* f = m_arena.floorplan(root);
+        assert(0 != f);
+        const Point p1 = position(f1);
+        const Point p2 = position(f2);
+        if (f->type == Floorplan::H) {
+            if (p1.y < p2.y) {
+                moveToSide(root, f1, SlicingStructure::TOP, f->type);
+                moveToSide(root, f2, SlicingStructure::BOTTOM, f->type);
+            } else if (p1.y > p2.y) {
+                moveToSide(root, f1, SlicingStructure::BOTTOM, f->type);
+                moveToSide(root, f2, SlicingStructure::TOP, f->type);
+            }
+            // reduce dist in vert dir
+            moveToSide(root, f1, SlicingStructure::RIGHT, Floorplan::V);
+            moveToSide(root, f2, SlicingStructure::RIGHT, Floorplan::V);
         } else {
-            isRightChild = false;
+            if (p1.x < p2.x) {
+                moveToSide(root, f1, SlicingStructure::RIGHT, f->type);
+                moveToSide(root, f2, SlicingStructure::LEFT, f->type);
+            } else if (p1.x > p2.x) {
+                moveToSide(root, f1, SlicingStructure::LEFT, f->type);
+                moveToSide(root, f2, SlicingStructure::RIGHT, f->type);
+            }
+            // reduce dist in horiz dir
+            moveToSide(root, f1, SlicingStructure::BOTTOM, Floorplan::H);
+            moveToSide(root, f2, SlicingStructure::BOTTOM, Floorplan::H);
+        }
+        if (0 != m_progress) {
+            m_progress->advance();
         }
     }
+}
 
+void SlicingStructure::moveToSide(Index root, Index leaf, Destination dest, Floorplan::Type type)
+{
+    // Walk up from the leaf to the root (exclusive) and put the path on the
+    // requested side of every floorplan of the given type
+    std::uint64_t visited = 0;
+    Index child = leaf;
+    Index index = m_arena.node(leaf)->parent;
+    while (index != root) {
+        assert(index != FloorplanArena::null);
+        Floorplan* floorplan = m_arena.floorplan(index);
+        ++visited;
+        if (type == floorplan->type) {
+            bool isRightChild = (floorplan->right == child);
+            if (isRightChild && (dest == SlicingStructure::LEFT || dest == SlicingStructure::BOTTOM)) {
+                floorplan->swapChildren(m_arena);
+            } else if (!isRightChild && (dest == SlicingStructure::RIGHT || dest == SlicingStructure::TOP)) {
+                floorplan->swapChildren(m_arena);
+            }
+        }
+        child = index;
+        index = floorplan->parent;
+    }
+    Profiler::count(Profiler::NodesVisited, visited);
 }
 
-bool SlicingStructure::findPath(BaseFloorplan* root, LeafFloorplan* f, std::vector<Floorplan*>& path) {
-    if (!root) {
-        return false;
+template <typename Step>
+void SlicingStructure::sweepUpward(Index f, const Step& step)
+{
+    const Floorplan* floorplan = m_arena.floorplan(f);
+    if (0 == floorplan) {
+        step(f);
+        Profiler::count(Profiler::NodesVisited);
+        return;
+    }
+    if (forkChildren(floorplan)) {
+        const Index left = floorplan->left;
+        ThreadPool::TaskGroup group(*m_threadPool);
+        group.run([this, left, &step] { sweepUpward(left, step); });
+        sweepUpward(floorplan->right, step);
+        group.wait();
+        step(f);
+        Profiler::count(Profiler::NodesVisited);
+        return;
     }
 
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(root);
-    if (leaf) {
-        if (leaf->module->name == f->module->name) {
-            return true;
-         } else {
-             return false;
-         }
+    // Children follow their parents in the compact order, so going
+    // backwards visits both children of a floorplan before it
+    utils::VisitCounter visits(m_progress);
+    for (Index i = f + (*m_subtreeLeaves)[f] - 1; i-- > f; ) {
+        const Floorplan* current = m_arena.floorplan(i);
+        if (FloorplanArena::isLeafIndex(current->left)) {
+            step(current->left);
+            visits.visit();
+        }
+        if (FloorplanArena::isLeafIndex(current->right)) {
+            step(current->right);
+            visits.visit();
+        }
+        step(i);
+        visits.visit();
     }
+    visits.finish();
+}
 
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(root);
-    assert(0 != floorplan);
-    if (findPath(floorplan->left, f, path) || findPath(floorplan->right, f, path)) {
-        path.push_back(floorplan);
-        return true;
+template <typename Step>
+void SlicingStructure::sweepDownward(Index f, const Step& step)
+{
+    Floorplan* floorplan = m_arena.floorplan(f);
+    if (0 == floorplan) {
+        return;
+    }
+    step(floorplan);
+    if (forkChildren(floorplan)) {
+        const Index left = floorplan->left;
+        ThreadPool::TaskGroup group(*m_threadPool);
+        group.run([this, left, &step] { sweepDownward(left, step); });
+        sweepDownward(floorplan->right, step);
+        group.wait();
+        Profiler::count(Profiler::NodesVisited);
+        return;
     }
-    return false;
+
+    utils::VisitCounter visits(m_progress);
+    visits.visit();
+    const Index end = f + (*m_subtreeLeaves)[f] - 1;
+    for (Index i = f + 1; i < end; ++i) {
+        step(m_arena.floorplan(i));
+        visits.visit();
+    }
+    visits.finish();
 }
 
 void SlicingStructure::applyNetMigration(const std::set<Module*>& moduleNets, const Point& target)
 {
+    if (m_root == FloorplanArena::null) {
+        return;
+    }
+    ScopedTimer timer("net migration");
+    // All nodes on the way up, floorplans on the way down
+    startProgress("Net migration", 3 * m_arena.leafCount());
+    updateCoordinates();
+    m_arena.detach();   // the pass changes every node, possibly from several threads
+
     // Traverse from leafs to root
-    _applyNetMigrationUpward(m_floorplan, moduleNets, target);
+    {
+        ScopedTimer pass("upward pass");
+        _applyNetMigrationUpward(m_root, moduleNets, target);
+    }
 
     // Traverse from root to leafs
-    _applyNetMigrationDownward(m_floorplan, moduleNets, target);
+    {
+        ScopedTimer pass("downward pass");
+        _applyNetMigrationDownward(m_root, moduleNets, target);
+    }
+
+    m_migrationNet = moduleNets;
+    m_migrationTarget = target;
+    m_migrationValid = true;
 }
 
-void SlicingStructure::_applyNetMigrationUpward(BaseFloorplan* f, const std::set<Module*>& moduleNets, const Point& target)
+void SlicingStructure::applyNetMigrationIncremental(const std::set<Module*>& moduleNets, const Point& target)
 {
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(f);
-    if (leaf != 0) {
-        if (moduleNets.find(leaf->module) != moduleNets.end()) {
-            f->centerOfGravity = Point((f->rect.right() + f->rect.left()) / 2, 
-                                        (f->rect.top() + f->rect.bottom()) / 2);
-            f->weight = f->rect.width() * f->rect.height();
-        } else {
-            f->centerOfGravity = Point::undefined;
-            f->weight = 0;
+    if (!m_migrationValid || !(target == m_migrationTarget)) {
+        applyNetMigration(moduleNets, target);
+        return;
+    }
+    ScopedTimer timer("net migration");
+    startProgress("Net migration", 0);
+
+    // Mark leaves which joined or left the net and all their ancestors
+    std::vector<Module*> changed;
+    std::set_symmetric_difference(moduleNets.begin(), moduleNets.end(),
+                                  m_migrationNet.begin(), m_migrationNet.end(),
+                                  std::back_inserter(changed));
+    std::unordered_set<Index> dirty;
+    std::vector<Module*>::const_iterator it;
+    for (it = changed.begin(); it != changed.end(); ++it) {
+        Index f = leafOf(*it);
+        while (f != FloorplanArena::null && dirty.insert(f).second) {
+            f = m_arena.node(f)->parent;
         }
-		return;
+    }
+    m_migrationNet = moduleNets;
+    if (dirty.empty()) {
+        return;
     }
 
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(f);
-    assert(0 != floorplan);
+    // Subtrees swapped on the way up have to be repositioned on the way down
+    std::unordered_set<Index> moved;
+    {
+        ScopedTimer pass("upward pass");
+        _applyNetMigrationUpward(m_root, moduleNets, target, &dirty, &moved);
+    }
+    dirty.insert(moved.begin(), moved.end());
+    ScopedTimer pass("downward pass");
+    _applyNetMigrationDownward(m_root, moduleNets, target, &dirty);
+}
 
-    _applyNetMigrationUpward(floorplan->left, moduleNets, target);
-    _applyNetMigrationUpward(floorplan->right, moduleNets, target);
+void SlicingStructure::_applyNetMigrationUpward(Index f, const std::set<Module*>& moduleNets, const Point& target,
+                                                const std::unordered_set<Index>* dirty, std::unordered_set<Index>* moved)
+{
+    if (dirty == 0 && m_compact) {
+        sweepUpward(f, [this, &moduleNets, &target](Index i) {
+            Floorplan* floorplan = m_arena.floorplan(i);
+            if (0 == floorplan) {
+                utils::setLeafWeight(m_arena.leaf(i), moduleNets);
+            } else {
+                mergeMigrationUpward(floorplan, target, 0);
+            }
+        });
+        return;
+    }
 
-    floorplan->rect = floorplan->mergedRect();
-    floorplan->weight = floorplan->left->weight + floorplan->right->weight;
+    // Post-order with an explicit stack: a floorplan is merged when it is
+    // seen the second time, after both children
+    utils::VisitCounter visits(m_progress);
+    std::vector<std::pair<Index, bool> > stack(1, std::make_pair(f, false));
+    while (!stack.empty()) {
+        const std::pair<Index, bool> top = stack.back();
+        stack.pop_back();
+
+        Floorplan* floorplan = m_arena.floorplan(top.first);
+        if (0 == floorplan) {
+            utils::setLeafWeight(m_arena.leaf(top.first), moduleNets);
+            visits.visit();
+            continue;
+        }
+
+        if (!top.second) {
+            stack.push_back(std::make_pair(top.first, true));
+            if (dirty == 0 && forkChildren(floorplan)) {
+                const Index left = floorplan->left;
+                ThreadPool::TaskGroup group(*m_threadPool);
+                group.run([this, left, &moduleNets, &target] { _applyNetMigrationUpward(left, moduleNets, target); });
+                _applyNetMigrationUpward(floorplan->right, moduleNets, target);
+                group.wait();
+            } else {
+                if (dirty == 0 || dirty->count(floorplan->right) != 0) {
+                    stack.push_back(std::make_pair(floorplan->right, false));
+                }
+                if (dirty == 0 || dirty->count(floorplan->left) != 0) {
+                    stack.push_back(std::make_pair(floorplan->left, false));
+                }
+            }
+            continue;
+        }
+
+        mergeMigrationUpward(floorplan, target, moved);
+        visits.visit();
+    }
+    visits.finish();
+}
+
+void SlicingStructure::mergeMigrationUpward(Floorplan* floorplan, const Point& target, std::unordered_set<Index>* moved)
+{
+    floorplan->rect = floorplan->mergedRect(m_arena);
+    floorplan->weight = m_arena.left(floorplan)->weight + m_arena.right(floorplan)->weight;
 
     // If floorplan has 0 weight, no need to optimize anything
     if (0 == floorplan->weight) {
         return;
     }
 
-    const Point& mergedCenter = utils::mergedCenterOfGravity(floorplan->left, floorplan->right);
-    const Point& swappedCenter = utils::swappedCenterOfGravity(floorplan);
+    const SwapCenters centers = evaluateSwap(m_arena.left(floorplan), m_arena.right(floorplan), floorplan->type);
 
-    if (utils::swapCondition(mergedCenter, swappedCenter, target)) {
-        floorplan->swapChildren();
-        floorplan->centerOfGravity = swappedCenter;
+    if (utils::swapCondition(centers.merged, centers.swapped, target)) {
+        floorplan->swapChildren(m_arena);
+        floorplan->centerOfGravity = centers.swapped;
+        if (moved != 0) {
+            moved->insert(floorplan->left);
+            moved->insert(floorplan->right);
+        }
     } else {
-        floorplan->centerOfGravity = mergedCenter;
+        floorplan->centerOfGravity = centers.merged;
     }
 }
 
-void SlicingStructure::_applyNetMigrationDownward(BaseFloorplan* f, const std::set<Module*>& moduleNets, const Point& target)
+void SlicingStructure::_applyNetMigrationDownward(Index f, const std::set<Module*>& moduleNets, const Point& target,
+                                                  const std::unordered_set<Index>* dirty)
 {
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(f);
-    if (0 != leaf) {
+    if (dirty == 0 && m_compact) {
+        sweepDownward(f, [this, &target](Floorplan* floorplan) {
+            applyNetMigrationDownwardStep(floorplan, target);
+        });
         return;
     }
 
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(f);
-    assert(0 != floorplan);
+    utils::VisitCounter visits(m_progress);
+    std::vector<Index> stack(1, f);
+    while (!stack.empty()) {
+        Floorplan* floorplan = m_arena.floorplan(stack.back());
+        stack.pop_back();
+        if (0 == floorplan) {
+            continue;
+        }
+        visits.visit();
+
+        // Remember where the children were, to find out which of them move
+        const Index left = floorplan->left;
+        const Index right = floorplan->right;
+        const Point leftOrigin = utils::origin(m_arena.node(left));
+        const Point rightOrigin = utils::origin(m_arena.node(right));
+
+        applyNetMigrationDownwardStep(floorplan, target);
+
+        // Go down to children
+        if (dirty == 0 && forkChildren(floorplan)) {
+            ThreadPool::TaskGroup group(*m_threadPool);
+            group.run([this, left, &moduleNets, &target] { _applyNetMigrationDownward(left, moduleNets, target); });
+            _applyNetMigrationDownward(right, moduleNets, target);
+            group.wait();
+            continue;
+        }
+        if (dirty == 0 || dirty->count(right) != 0 || !(utils::origin(m_arena.node(right)) == rightOrigin)) {
+            stack.push_back(right);
+        }
+        if (dirty == 0 || dirty->count(left) != 0 || !(utils::origin(m_arena.node(left)) == leftOrigin)) {
+            stack.push_back(left);
+        }
+    }
+    visits.finish();
+}
 
+void SlicingStructure::applyNetMigrationDownwardStep(Floorplan* floorplan, const Point& target)
+{
     // Fix coords of children
-    floorplan->recalculateChildrenCoords();
+    floorplan->recalculateChildrenCoords(m_arena);
 
     // If floorplan has 0 weight, no need to optimize anything
     if (0 != floorplan->weight) {
         // Check if further swap will make any improvment
-        const Point& swappedCenter = utils::swappedCenterOfGravity(floorplan);
+        const Point swappedCenter = evaluateSwap(m_arena.left(floorplan), m_arena.right(floorplan), floorplan->type).swapped;
         if (utils::swapCondition(floorplan->centerOfGravity, swappedCenter, target)) {
-            floorplan->swapChildren();
+            floorplan->swapChildren(m_arena);
+            floorplan->recalculateChildrenCoords(m_arena);
             floorplan->centerOfGravity = swappedCenter;
         }
     }
-
-    // Go recursively down to children
-    _applyNetMigrationDownward(floorplan->left, moduleNets, target);
-    _applyNetMigrationDownward(floorplan->right, moduleNets, target);
 }
 
 void SlicingStructure::applyNetContraction(const std::set<Module*>& netModules)
 {
-    calculateWeights(m_floorplan, netModules);
-    applyNetContractionDownward(m_floorplan, netModules);
+    m_migrationValid = false;
+    if (m_root == FloorplanArena::null) {
+        return;
+    }
+
+    ScopedTimer timer("net contraction");
+    // Weights of all nodes, then a migration of either half
+    startProgress("Net contraction", 5 * m_arena.leafCount());
+    updateCoordinates();
+    m_arena.detach();   // the pass changes every node, possibly from several threads
+    {
+        ScopedTimer pass("upward pass");
+        calculateWeights(m_root, netModules);
+    }
+    ScopedTimer pass("downward pass");
+    applyNetContractionDownward(m_root, netModules);
 }
 
-void SlicingStructure::calculateWeights(BaseFloorplan* f, const std::set<Module*>& moduleNets)
+void SlicingStructure::calculateWeights(Index f, const std::set<Module*>& moduleNets)
 {
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(f);
-    if (leaf != 0) {
-        if (moduleNets.find(leaf->module) != moduleNets.end()) {
-            f->centerOfGravity = Point((f->rect.right() + f->rect.left()) / 2,
-                                        (f->rect.top() + f->rect.bottom()) / 2);
-            f->weight = f->rect.width() * f->rect.height();
-        } else {
-            f->centerOfGravity = Point::undefined;
-            f->weight = 0;
-        }
+    if (m_compact) {
+        sweepUpward(f, [this, &moduleNets](Index i) {
+            Floorplan* floorplan = m_arena.floorplan(i);
+            if (0 == floorplan) {
+                utils::setLeafWeight(m_arena.leaf(i), moduleNets);
+            } else {
+                mergeWeights(floorplan);
+            }
+        });
         return;
     }
 
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(f);
-    assert(0 != floorplan);
+    // Post-order with an explicit stack, as in _applyNetMigrationUpward
+    utils::VisitCounter visits(m_progress);
+    std::vector<std::pair<Index, bool> > stack(1, std::make_pair(f, false));
+    while (!stack.empty()) {
+        const std::pair<Index, bool> top = stack.back();
+        stack.pop_back();
+
+        Floorplan* floorplan = m_arena.floorplan(top.first);
+        if (0 == floorplan) {
+            utils::setLeafWeight(m_arena.leaf(top.first), moduleNets);
+            visits.visit();
+            continue;
+        }
+
+        if (!top.second) {
+            stack.push_back(std::make_pair(top.first, true));
+            if (forkChildren(floorplan)) {
+                const Index left = floorplan->left;
+                ThreadPool::TaskGroup group(*m_threadPool);
+                group.run([this, left, &moduleNets] { calculateWeights(left, moduleNets); });
+                calculateWeights(floorplan->right, moduleNets);
+                group.wait();
+            } else {
+                stack.push_back(std::make_pair(floorplan->right, false));
+                stack.push_back(std::make_pair(floorplan->left, false));
+            }
+            continue;
+        }
 
-    calculateWeights(floorplan->left, moduleNets);
-    calculateWeights(floorplan->right, moduleNets);
+        mergeWeights(floorplan);
+        visits.visit();
+    }
+    visits.finish();
+}
 
-    floorplan->rect = floorplan->mergedRect();
-    floorplan->weight = floorplan->left->weight + floorplan->right->weight;
+void SlicingStructure::mergeWeights(Floorplan* floorplan)
+{
+    floorplan->rect = floorplan->mergedRect(m_arena);
+    floorplan->weight = m_arena.left(floorplan)->weight + m_arena.right(floorplan)->weight;
 
     // If floorplan has 0 weight, no need to optimize anything
     if (0 == floorplan->weight) {
         return;
     }
 
-    const Point& mergedCenter = utils::mergedCenterOfGravity(floorplan->left, floorplan->right);
+    const Point& mergedCenter = utils::mergedCenterOfGravity(m_arena.left(floorplan), m_arena.right(floorplan));
     floorplan->centerOfGravity= mergedCenter;
 }
 
-void SlicingStructure::applyNetContractionDownward(BaseFloorplan* f, const std::set<Module*>& moduleNets)
+void SlicingStructure::applyNetContractionDownward(Index f, const std::set<Module*>& moduleNets)
 {
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(f);
-    if (0 != leaf) {
+    Floorplan* floorplan = m_arena.floorplan(f);
+    if (0 == floorplan) {
         return;
     }
 
-    if (0 == f->weight)
+    if (0 == floorplan->weight)
     {
         return;
     }
 
-    Floorplan* floorplan = dynamic_cast<Floorplan*>(f);
-    assert(0 != floorplan);
+    const Index leftIndex = floorplan->left;
+    const Index rightIndex = floorplan->right;
+    BaseFloorplan* left = m_arena.node(leftIndex);
+    BaseFloorplan* right = m_arena.node(rightIndex);
+
+    if (!forkChildren(floorplan)) {
+        // net migration for left subfloorplan
+        _applyNetMigrationUpward(leftIndex, moduleNets, right->centerOfGravity);
+        _applyNetMigrationDownward(leftIndex, moduleNets, right->centerOfGravity);
 
-    // net migration for left subfloorplan
-    _applyNetMigrationUpward(floorplan->left, moduleNets, floorplan->right->centerOfGravity);
-    _applyNetMigrationDownward(floorplan->left, moduleNets, floorplan->right->centerOfGravity);
+        // net migration for the right subfloorplan
+        _applyNetMigrationUpward(rightIndex, moduleNets, left->centerOfGravity);
+        _applyNetMigrationDownward(rightIndex, moduleNets, left->centerOfGravity);
+        return;
+    }
 
-    // net migration for the right subfloorplan
-    _applyNetMigrationUpward(floorplan->right, moduleNets, floorplan->left->centerOfGravity);
-    _applyNetMigrationDownward(floorplan->right, moduleNets, floorplan->left->centerOfGravity);
+    // The right subfloorplan moves towards the center of the left one after
+    // its migration, which is final once the left root is processed. The
+    // rest of both migrations touch disjoint subtrees.
+    const Point leftTarget = right->centerOfGravity;
+    _applyNetMigrationUpward(leftIndex, moduleNets, leftTarget);
+    Floorplan* leftFloorplan = left->asFloorplan();
+    assert(0 != leftFloorplan);
+    applyNetMigrationDownwardStep(leftFloorplan, leftTarget);
+    const Point rightTarget = left->centerOfGravity;
+
+    ThreadPool::TaskGroup group(*m_threadPool);
+    const Index leftChildren[2] = {leftFloorplan->left, leftFloorplan->right};
+    for (int i = 0; i < 2; ++i) {
+        const Index child = leftChildren[i];
+        group.run([this, child, &moduleNets, &leftTarget] { _applyNetMigrationDownward(child, moduleNets, leftTarget); });
+    }
+    _applyNetMigrationUpward(rightIndex, moduleNets, rightTarget);
+    _applyNetMigrationDownward(rightIndex, moduleNets, rightTarget);
+    group.wait();
 }
 
-void SlicingStructure::print()
+// Merges the nets of two children, both sorted by net id
+void SlicingStructure::mergeNetTerms(const NetTerm* left, const NetTerm* leftEnd,
+                                     const NetTerm* right, const NetTerm* rightEnd,
+                                     const Point& offset, std::vector<NetTerm>& result)
 {
-    std::map<double, XCoordFloorplans* >::const_iterator xIt;
-    for (xIt = m_xFlrp.begin(); xIt != m_xFlrp.end(); ++xIt) {
-        std::cout<<xIt->first<<": ";
-        while (!xIt->second->empty()) {
-            Module* m = dynamic_cast<LeafFloorplan*>(xIt->second->top())->module;
-            std::cout<<m->name<<" ";
-            std::cout<<m->rect.x()<<","<<m->rect.y()<<","<<m->rect.width()<<","<<m->rect.height()<<" \t";
-            xIt->second->pop();
+    result.clear();
+    while (left != leftEnd || right != rightEnd) {
+        NetTerm term;
+        if (right == rightEnd || (left != leftEnd && left->net < right->net)) {
+            term = *left++;
+        } else if (left == leftEnd || right->net < left->net) {
+            term = *right++;
+            term.center = Point(term.center.x + offset.x, term.center.y + offset.y);
+        } else {
+            // c = c1 * w1 / (w1 + w2) + c2 * w2 / (w1 + w2)
+            term.net = left->net;
+            term.weight = left->weight + right->weight;
+            double coef1 = left->weight / term.weight;
+            double coef2 = right->weight / term.weight;
+            term.center.x = coef1 * left->center.x + coef2 * (right->center.x + offset.x);
+            term.center.y = coef1 * left->center.y + coef2 * (right->center.y + offset.y);
+            ++left;
+            ++right;
         }
-        std::cout<<std::endl;
+        result.push_back(term);
     }
-    std::map<double, YCoordFloorplans* >::const_iterator yIt;
-    for (yIt = m_yFlrp.begin(); yIt != m_yFlrp.end(); ++yIt) {
-        std::cout<<yIt->first<<": ";
-        while (!yIt->second->empty()) {
-            Module* m = dynamic_cast<LeafFloorplan*>(yIt->second->top())->module;
-            std::cout<<m->name<<" ";
-            std::cout<<m->rect.x()<<","<<m->rect.y()<<","<<m->rect.width()<<","<<m->rect.height()<<" \t";
-            yIt->second->pop();
-        }
-        std::cout<<std::endl;
+}
+
+void SlicingStructure::applyNetMigration(const Netlist& netlist, const Point& target)
+{
+    m_migrationValid = false;
+    if (m_root == FloorplanArena::null) {
+        return;
+    }
+    ScopedTimer timer("net migration");
+    startProgress("Net migration", 3 * m_arena.leafCount());
+    assert(netlist.moduleCount() == m_arena.leafCount());
+    updateCoordinates();
+    m_arena.detach();   // the pass changes every node, possibly from several threads
+
+    NetCenters nets(m_arena);
+    NetTargets targets(target);
+    {
+        ScopedTimer pass("upward pass");
+        collectNets(m_root, netlist, nets, &targets);
     }
+    ScopedTimer pass("downward pass");
+    migrateNetsDownward(m_root, nets, targets, nets.swapped);
 }
 
-void SlicingStructure::fillFloorplanMaps(std::vector<Module*> modules)
+void SlicingStructure::applyNetContraction(const Netlist& netlist)
 {
-    std::vector<Module*>::const_iterator it;
-    for (it = modules.begin(); it != modules.end(); ++it) {
-        BaseFloorplan* floorplan = new LeafFloorplan(*it);
-        double x = (*it)->rect.x();
-        double y = (*it)->rect.y();
-        xMapPush(x, floorplan);
-        yMapPush(y, floorplan);
-    }
-}
-
-void SlicingStructure::mergeXFloorplans()
-{
-    std::map<double, XCoordFloorplans* >::iterator it = m_xFlrp.begin();
-    for (it = m_xFlrp.begin(); it != m_xFlrp.end(); it++) {
-        double currentXCoord = (*it).first;
-        XCoordFloorplans* xCurrentQueue = (*it).second;
-        BaseFloorplan* currentX = xMapPop(xCurrentQueue);
-        XCoordFloorplans* mergedXQueue = new XCoordFloorplans();
-        while (!xCurrentQueue->empty()) {
-            BaseFloorplan* nextX = xMapPop(xCurrentQueue);
-//            std::cout<<nextX->rect.x()<<" "<<nextX->rect.y()<<" "<<nextX->rect.width()<<" "<<nextX->rect.height()<<"\n";
-            if (areHorizontalSiblings(currentX, nextX)) {
-                BaseFloorplan* mergedFloorplan = new Floorplan(currentX, nextX, Floorplan::H);
-                currentX = mergedFloorplan;
-            } else {
-                mergedXQueue->push(currentX);
-                currentX = nextX;
+    m_migrationValid = false;
+    if (m_root == FloorplanArena::null) {
+        return;
+    }
+    ScopedTimer timer("net contraction");
+    startProgress("Net contraction", 5 * m_arena.leafCount());
+    assert(netlist.moduleCount() == m_arena.leafCount());
+    updateCoordinates();
+    m_arena.detach();   // the pass changes every node, possibly from several threads
+
+    NetCenters nets(m_arena);
+    {
+        ScopedTimer pass("upward pass");
+        collectNets(m_root, netlist, nets, 0);
+    }
+    Floorplan* root = m_arena.floorplan(m_root);
+    if (0 == root || nets.empty(m_root)) {
+        return;
+    }
+
+    // Move the nets of each half towards their centers in the other half
+    const Index left = root->left;
+    const Index right = root->right;
+    NetTargets toRight(nets, right, utils::origin(m_arena.node(right)));
+    {
+        ScopedTimer pass("upward pass");
+        collectNets(left, netlist, nets, &toRight);
+    }
+    {
+        ScopedTimer pass("downward pass");
+        migrateNetsDownward(left, nets, toRight, nets.swapped);
+    }
+
+    NetTargets toLeft(nets, left, utils::origin(m_arena.node(left)));
+    {
+        ScopedTimer pass("upward pass");
+        collectNets(right, netlist, nets, &toLeft);
+    }
+    ScopedTimer pass("downward pass");
+    migrateNetsDownward(right, nets, toLeft, nets.swapped);
+}
+
+void SlicingStructure::collectNets(Index f, const Netlist& netlist, NetCenters& nets, const NetTargets* targets)
+{
+    // Post-order with an explicit stack, as in _applyNetMigrationUpward
+    utils::VisitCounter visits(m_progress);
+    std::vector<std::pair<Index, bool> > stack(1, std::make_pair(f, false));
+    while (!stack.empty()) {
+        const std::pair<Index, bool> top = stack.back();
+        stack.pop_back();
+        const Index index = top.first;
+        BaseFloorplan* node = m_arena.node(index);
+        if (node->isLeaf() || top.second) {
+            visits.visit();
+        }
+
+        if (node->isLeaf()) {
+            const Netlist::Id module = index & ~FloorplanArena::leafBit;
+            nets.merged.clear();
+            for (const Netlist::Id* it = netlist.moduleNetsBegin(module); it != netlist.moduleNetsEnd(module); ++it) {
+                NetTerm term;
+                term.net = *it;
+                term.weight = static_cast<double>(node->rect.width()) * node->rect.height();
+                term.center = Point(node->rect.width() / 2.0, node->rect.height() / 2.0);
+                nets.merged.push_back(term);
+            }
+            nets.assign(index, nets.merged);
+            continue;
+        }
+
+        Floorplan* floorplan = node->asFloorplan();
+        if (!top.second) {
+            stack.push_back(std::make_pair(index, true));
+            stack.push_back(std::make_pair(floorplan->right, false));
+            stack.push_back(std::make_pair(floorplan->left, false));
+            continue;
+        }
+        floorplan->rect = floorplan->mergedRect(m_arena);
+
+        const BaseFloorplan* left = m_arena.left(floorplan);
+        const BaseFloorplan* right = m_arena.right(floorplan);
+        mergeNetTerms(nets.begin(floorplan->left), nets.end(floorplan->left),
+                      nets.begin(floorplan->right), nets.end(floorplan->right),
+                      utils::rightOffset(left, floorplan->type), nets.merged);
+        if (0 != targets && !nets.merged.empty()) {
+            mergeNetTerms(nets.begin(floorplan->right), nets.end(floorplan->right),
+                          nets.begin(floorplan->left), nets.end(floorplan->left),
+                          utils::rightOffset(right, floorplan->type), nets.swapped);
+            const Point origin = utils::origin(floorplan);
+            const std::vector<NetTerm>& merged = nets.merged;
+            const std::vector<NetTerm>& swapped = nets.swapped;
+            if (targets->distance(merged.data(), merged.data() + merged.size(), origin) >
+                targets->distance(swapped.data(), swapped.data() + swapped.size(), origin)) {
+                floorplan->swapChildren(m_arena);
+                nets.assign(index, swapped);
+                continue;
             }
         }
-        mergedXQueue->push(currentX);
-        m_xFlrp[currentXCoord] = mergedXQueue;
+        nets.assign(index, nets.merged);
     }
+    visits.finish();
 }
 
-void SlicingStructure::mergeYFloorplans()
+void SlicingStructure::migrateNetsDownward(Index f, NetCenters& nets, const NetTargets& targets, std::vector<NetTerm>& swapped)
 {
-    std::map<double, YCoordFloorplans* >::iterator it = m_yFlrp.begin();
-    for (it = m_yFlrp.begin(); it != m_yFlrp.end(); it++) {
-        double currentYCoord = (*it).first;
-        YCoordFloorplans* yCurrentQueue = (*it).second;
-        BaseFloorplan* currentY = yMapPop(yCurrentQueue);
-        YCoordFloorplans* mergedYQueue = new YCoordFloorplans();
-        while (!yCurrentQueue->empty()) {
-            BaseFloorplan* nextY = yMapPop(yCurrentQueue);
-  //          std::cout<<nextY->rect.x()<<" "<<nextY->rect.y()<<" "<<nextY->rect.width()<<" "<<nextY->rect.height()<<"\n";
-            if (areVerticalSiblings(currentY, nextY)) {
-                BaseFloorplan* mergedFloorplan = new Floorplan(currentY, nextY, Floorplan::V);
-                currentY = mergedFloorplan;
-            } else {
-                mergedYQueue->push(currentY);
-                currentY = nextY;
+    utils::VisitCounter visits(m_progress);
+    std::vector<Index> stack(1, f);
+    while (!stack.empty()) {
+        const Index index = stack.back();
+        stack.pop_back();
+        Floorplan* floorplan = m_arena.floorplan(index);
+        if (0 == floorplan) {
+            continue;
+        }
+        visits.visit();
+
+        // Fix coords of children
+        floorplan->recalculateChildrenCoords(m_arena);
+
+        // Check if further swap will make any improvment
+        if (!nets.empty(index)) {
+            mergeNetTerms(nets.begin(floorplan->right), nets.end(floorplan->right),
+                          nets.begin(floorplan->left), nets.end(floorplan->left),
+                          utils::rightOffset(m_arena.right(floorplan), floorplan->type), swapped);
+            const Point origin = utils::origin(floorplan);
+            if (targets.distance(nets.begin(index), nets.end(index), origin) >
+                targets.distance(swapped.data(), swapped.data() + swapped.size(), origin)) {
+                floorplan->swapChildren(m_arena);
+                floorplan->recalculateChildrenCoords(m_arena);
+                nets.update(index, swapped);
             }
         }
-        mergedYQueue->push(currentY);
-        m_yFlrp[currentYCoord] = mergedYQueue;
+
+        // Forked subtrees need their own buffer
+        if (forkChildren(floorplan)) {
+            const Index left = floorplan->left;
+            ThreadPool::TaskGroup group(*m_threadPool);
+            group.run([this, left, &nets, &targets] {
+                std::vector<NetTerm> buffer;
+                migrateNetsDownward(left, nets, targets, buffer);
+            });
+            migrateNetsDownward(floorplan->right, nets, targets, swapped);
+            group.wait();
+        } else {
+            stack.push_back(floorplan->right);
+            stack.push_back(floorplan->left);
+        }
     }
+    visits.finish();
 }
 
-BaseFloorplan* SlicingStructure::lowestCommonAncestor(BaseFloorplan* root, LeafFloorplan* f1, LeafFloorplan* f2) const
+void SlicingStructure::countSubtreeLeaves()
 {
-    if (root == 0) {
-        return 0;
+    // A new vector, as snapshots may share the old one
+    std::shared_ptr<std::vector<std::uint32_t> > counts =
+            std::make_shared<std::vector<std::uint32_t> >(m_arena.floorplanCount(), 0);
+    m_subtreeLeaves = counts;
+    if (m_root == FloorplanArena::null || FloorplanArena::isLeafIndex(m_root)) {
+        return;
     }
 
-    LeafFloorplan* leaf = dynamic_cast<LeafFloorplan*>(root);
-    if (leaf) {
-        if (f1->module->name == leaf->module->name || f2->module->name == leaf->module->name) {
-            return root;
-        } else {
-            return 0;
+    const FloorplanArena& arena = m_arena;
+    std::vector<std::uint32_t>& subtreeLeaves = *counts;
+
+    // Post-order with an explicit stack: a floorplan is counted when it is
+    // seen the second time, after both children
+    std::vector<std::pair<Index, bool> > stack(1, std::make_pair(m_root, false));
+    while (!stack.empty()) {
+        std::pair<Index, bool> top = stack.back();
+        stack.pop_back();
+        const Floorplan* floorplan = arena.floorplan(top.first);
+        if (top.second) {
+            subtreeLeaves[top.first] =
+                    (FloorplanArena::isLeafIndex(floorplan->left) ? 1 : subtreeLeaves[floorplan->left]) +
+                    (FloorplanArena::isLeafIndex(floorplan->right) ? 1 : subtreeLeaves[floorplan->right]);
+            continue;
+        }
+        stack.push_back(std::make_pair(top.first, true));
+        if (!FloorplanArena::isLeafIndex(floorplan->left)) {
+            stack.push_back(std::make_pair(floorplan->left, false));
+        }
+        if (!FloorplanArena::isLeafIndex(floorplan->right)) {
+            stack.push_back(std::make_pair(floorplan->right, false));
         }
     }
+}
 
-    Floorplan* f = dynamic_cast<Floorplan*>(root);
-    assert(0 != f);
-    BaseFloorplan* leftAnc = lowestCommonAncestor(f->left, f1, f2);
-    BaseFloorplan* rightAnc = lowestCommonAncestor(f->right, f1, f2);
-    if (leftAnc && rightAnc) {
-        return root;
+bool SlicingStructure::forkChildren(const Floorplan* f) const
+{
+    if (m_threadPool == 0) {
+        return false;
+    }
+    std::size_t left = FloorplanArena::isLeafIndex(f->left) ? 1 : (*m_subtreeLeaves)[f->left];
+    std::size_t right = FloorplanArena::isLeafIndex(f->right) ? 1 : (*m_subtreeLeaves)[f->right];
+    return left >= m_grainSize && right >= m_grainSize;
+}
+
+void SlicingStructure::buildSlicingTree(const std::vector<Module*>& modules, ThreadPool* pool, Progress* progress)
+{
+    ScopedTimer timer("build");
+    std::vector<Index> leaves;
+    leaves.reserve(modules.size());
+    std::shared_ptr<std::unordered_map<const Module*, Index> > leafOf =
+            std::make_shared<std::unordered_map<const Module*, Index> >();
+    std::vector<Module*>::const_iterator it;
+    leafOf->reserve(modules.size());
+    for (it = modules.begin(); it != modules.end(); ++it) {
+        leaves.push_back(m_arena.createLeaf(*it));
+        (*leafOf)[*it] = leaves.back();
     }
+    m_leaves = leafOf;
 
-    if (leftAnc != 0) {
-        return leftAnc;
+    // A tree of n leaves takes n - 1 merges
+    if (0 != progress) {
+        progress->start("Building", leaves.empty() ? 0 : leaves.size() - 1);
+    }
+    if (pool) {
+        ParallelSlicingTreeBuilder builder(m_arena, *pool);
+        builder.setProgress(progress);
+        m_root = builder.build(leaves);
+    } else {
+        SlicingTreeBuilder builder(m_arena);
+        builder.setProgress(progress);
+        m_root = builder.build(leaves);
     }
-    return rightAnc;
 }
 
-void SlicingStructure::buildSlicingTree()
+Point SlicingStructure::position(Index f) const
 {
-    while (!m_xFlrp.empty() && !m_yFlrp.empty()) {
-        mergeXFloorplans();
-        if (m_xFlrp.size() == 1) {
-            std::map<double, XCoordFloorplans* >::const_iterator it = m_xFlrp.begin();
-            if ((*it).second->size() == 1) {
-                m_floorplan = (*it).second->top();
-                return;
-            }
+    // Rectangles below a swapped floorplan may be stale, but the highest
+    // swapped floorplan itself is in place and sizes never change
+    std::vector<Index> path(1, f);
+    std::size_t top = 0;
+    for (Index p = m_arena.node(f)->parent; p != FloorplanArena::null; p = m_arena.node(p)->parent) {
+        path.push_back(p);
+        if (m_arena.floorplan(p)->swap) {
+            top = path.size() - 1;
         }
-        cleanUnusedXKeys(); // TODO call these functions onnly in case of modificationns
-        fillYMap();
+    }
 
-        mergeYFloorplans();
-        if (m_yFlrp.size() == 1) {
-            std::map<double, YCoordFloorplans* >::const_iterator it = m_yFlrp.begin();
-            if ((*it).second->size() == 1) {
-                m_floorplan = (*it).second->top();
-                return;
+    const Rectangle& rect = m_arena.node(path[top])->rect;
+    Point result(rect.x(), rect.y());
+    for (std::size_t i = top; i > 0; --i) {
+        const Floorplan* parent = m_arena.floorplan(path[i]);
+        if (parent->right == path[i - 1]) {
+            const BaseFloorplan* left = m_arena.left(parent);
+            if (parent->type == Floorplan::V) {
+                result.x += left->rect.width();
+            } else {
+                result.y += left->rect.height();
             }
         }
-        cleanUnusedYKeys();
-        fillXMap();
-
     }
+    return result;
 }
 
-bool SlicingStructure::areHorizontalSiblings(BaseFloorplan* f1, BaseFloorplan* f2) const
+namespace utils {
+
+// A node with the position it takes in the tree, derived on the way down
+// from the root, as rectangles below swapped floorplans may be stale
+struct PlacedNode
 {
-    if (f1->rect.left() == f2->rect.left() && f1->rect.right() == f2->rect.right() && f1->rect.top() == f2->rect.bottom()) {
-        return true;
-    }
-    return false;
+    FloorplanArena::Index index;
+    Rectangle rect;
+};
+
+PlacedNode placedRoot(const FloorplanArena& arena, FloorplanArena::Index root)
+{
+    PlacedNode result = {root, arena.node(root)->rect};
+    return result;
 }
 
-bool SlicingStructure::areVerticalSiblings(BaseFloorplan* f1, BaseFloorplan* f2) const
+void placeChildren(const FloorplanArena& arena, const Floorplan* floorplan, const Rectangle& rect, PlacedNode children[2])
 {
-    if (f1->rect.bottom() == f2->rect.bottom() && f1->rect.top() == f2->rect.top() && f2->rect.left() == f1->rect.right()) {
-        return true;
+    const Rectangle& left = arena.node(floorplan->left)->rect;
+    const Rectangle& right = arena.node(floorplan->right)->rect;
+    children[0].index = floorplan->left;
+    children[0].rect = Rectangle(rect.x(), rect.y(), left.width(), left.height());
+    children[1].index = floorplan->right;
+    if (floorplan->type == Floorplan::V) {
+        children[1].rect = Rectangle(rect.x() + left.width(), rect.y(), right.width(), right.height());
+    } else {
+        children[1].rect = Rectangle(rect.x(), rect.y() + left.height(), right.width(), right.height());
     }
-    return false;
 }
 
-BaseFloorplan* SlicingStructure::xMapPop(double x)
+bool contains(const Rectangle& rect, const Point& point)
 {
-    BaseFloorplan* top = m_xFlrp[x]->top();
-    m_xFlrp[x]->pop();
-    return top;
+    return rect.left() <= point.x && point.x <= rect.right() && rect.bottom() <= point.y && point.y <= rect.top();
 }
 
-BaseFloorplan* SlicingStructure::yMapPop(double y)
+double distance(const Rectangle& rect, const Point& point)
 {
-    BaseFloorplan* top = m_yFlrp[y]->top();
-    m_yFlrp[y]->pop();
-    return top;
+    const double dx = std::max(std::max(rect.left() - point.x, 0.0), point.x - rect.right());
+    const double dy = std::max(std::max(rect.bottom() - point.y, 0.0), point.y - rect.top());
+    return std::sqrt(dx * dx + dy * dy);
 }
 
-BaseFloorplan* SlicingStructure::xMapPop(XCoordFloorplans* xQueue)
+// Modules of the leaves whose rectangles reach, skipping subtrees which do not
+template <typename Reaches>
+std::vector<Module*> collectModules(const FloorplanArena& arena, FloorplanArena::Index root, const Reaches& reaches)
 {
-    BaseFloorplan* top = xQueue->top();
-    xQueue->pop();
-    return top;
+    std::vector<Module*> result;
+    if (root == FloorplanArena::null) {
+        return result;
+    }
+    std::vector<PlacedNode> stack(1, placedRoot(arena, root));
+    while (!stack.empty()) {
+        const PlacedNode node = stack.back();
+        stack.pop_back();
+        if (!reaches(node.rect)) {
+            continue;
+        }
+        const Floorplan* floorplan = arena.floorplan(node.index);
+        if (0 == floorplan) {
+            result.push_back(arena.leaf(node.index)->module);
+            continue;
+        }
+        PlacedNode children[2];
+        placeChildren(arena, floorplan, node.rect, children);
+        stack.push_back(children[1]);
+        stack.push_back(children[0]);
+    }
+    return result;
 }
 
-BaseFloorplan* SlicingStructure::yMapPop(YCoordFloorplans* yQueue)
-{
-    BaseFloorplan* top = yQueue->top();
-    yQueue->pop();
-    return top;
 }
 
-void SlicingStructure::xMapPush(double x, BaseFloorplan* f)
+Module* SlicingStructure::moduleAt(const Point& point) const
 {
-    if (m_xFlrp.find(x) == m_xFlrp.end()) {
-        m_xFlrp[x] = new XCoordFloorplans();
+    if (m_root == FloorplanArena::null) {
+        return 0;
+    }
+    utils::PlacedNode node = utils::placedRoot(m_arena, m_root);
+    if (!utils::contains(node.rect, point)) {
+        return 0;
+    }
+    // The children tile their parent, so the point is in one of them
+    while (true) {
+        const Floorplan* floorplan = m_arena.floorplan(node.index);
+        if (0 == floorplan) {
+            return m_arena.leaf(node.index)->module;
+        }
+        utils::PlacedNode children[2];
+        utils::placeChildren(m_arena, floorplan, node.rect, children);
+        node = utils::contains(children[0].rect, point) ? children[0] : children[1];
     }
-    m_xFlrp[x]->push(f);
 }
 
-void SlicingStructure::yMapPush(double y, BaseFloorplan* f)
+std::vector<Module*> SlicingStructure::modulesIn(const Rectangle& area) const
 {
-    if (m_yFlrp.find(y) == m_yFlrp.end()) {
-        m_yFlrp[y] = new YCoordFloorplans();
-    }
-    m_yFlrp[y]->push(f);
+    return utils::collectModules(m_arena, m_root, [&area](const Rectangle& rect) {
+        return rect.left() < area.right() && area.left() < rect.right()
+                && rect.bottom() < area.top() && area.bottom() < rect.top();
+    });
 }
 
-void SlicingStructure::cleanUnusedXKeys()
+std::vector<Module*> SlicingStructure::modulesWithin(const Point& center, double radius) const
 {
-    std::map<double, XCoordFloorplans* >::iterator it = m_xFlrp.begin();
-    while (it != m_xFlrp.end()) {
-        if ((*it).second->empty()) {
-            double keyToDelete = (*it).first;
-            delete (*it).second;
-            it++;
-            m_xFlrp.erase(keyToDelete);
-        } else {
-            ++it;
-        }
-    }
+    return utils::collectModules(m_arena, m_root, [&center, radius](const Rectangle& rect) {
+        return utils::distance(rect, center) <= radius;
+    });
 }
 
-void SlicingStructure::cleanUnusedYKeys()
+std::vector<Module*> SlicingStructure::nearestModules(const Point& point, std::size_t k) const
 {
-    std::map<double, YCoordFloorplans* >::iterator it = m_yFlrp.begin();
-    while (it != m_yFlrp.end()) {
-        if ((*it).second->empty()) {
-            double keyToDelete = (*it).first;
-            delete (*it).second;
-            it++;
-            m_yFlrp.erase(keyToDelete);
-        } else {
-            ++it;
+    // Best first: a node is never nearer than its parent, so leaves leave
+    // the queue in the order of their distance
+    typedef std::pair<double, utils::PlacedNode> Entry;
+    struct Farther
+    {
+        bool operator () (const Entry& a, const Entry& b) const
+        {
+            return a.first > b.first;
         }
+    };
+
+    std::vector<Module*> result;
+    if (m_root == FloorplanArena::null || k == 0) {
+        return result;
     }
+    std::priority_queue<Entry, std::vector<Entry>, Farther> queue;
+    const utils::PlacedNode root = utils::placedRoot(m_arena, m_root);
+    queue.push(Entry(utils::distance(root.rect, point), root));
+    while (!queue.empty() && result.size() < k) {
+        const utils::PlacedNode node = queue.top().second;
+        queue.pop();
+        const Floorplan* floorplan = m_arena.floorplan(node.index);
+        if (0 == floorplan) {
+            result.push_back(m_arena.leaf(node.index)->module);
+            continue;
+        }
+        utils::PlacedNode children[2];
+        utils::placeChildren(m_arena, floorplan, node.rect, children);
+        for (int i = 0; i < 2; ++i) {
+            queue.push(Entry(utils::distance(children[i].rect, point), children[i]));
+        }
+    }
+    return result;
 }
 
-void SlicingStructure::fillXMap()
+std::size_t SlicingStructure::moduleIndex(const Module* module) const
 {
-    m_xFlrp.clear();
-    std::map<double, YCoordFloorplans* > copy = std::map<double, YCoordFloorplans* >(m_yFlrp);
-    std::map<double, YCoordFloorplans* >::const_iterator it = copy.begin();
-    for (; it != copy.end(); ++it) {
-        YCoordFloorplans* queue = (*it).second;
-        while (!queue->empty()) {
-            BaseFloorplan* f = queue->top();
-            queue->pop();
-            xMapPush(f->rect.x(), f);
-        }
-    }
+    return leafOf(module) & ~FloorplanArena::leafBit;
 }
 
-void SlicingStructure::fillYMap()
+SlicingStructure::Index SlicingStructure::leafOf(const Module* module) const
 {
-    m_yFlrp.clear();
-    std::map<double, XCoordFloorplans* > copy = std::map<double, XCoordFloorplans* >(m_xFlrp);
-    std::map<double, XCoordFloorplans* >::const_iterator it = copy.begin();
-    for (; it != copy.end(); ++it) {
-        XCoordFloorplans* queue = (*it).second;
-        while (!queue->empty()) {
-            BaseFloorplan* f = queue->top();
-            queue->pop();
-            yMapPush(f->rect.y(), f);
-        }
-    }
+    std::unordered_map<const Module*, Index>::const_iterator it = m_leaves->find(module);
+    assert(it != m_leaves->end());
+    return it->second;
 }
 
+SlicingStructure::Index SlicingStructure::lowestCommonAncestor(Index f1, Index f2) const
+{
+    // Lift the deeper node to the depth of the other one, then lift both
+    // until they meet
+    std::size_t depth1 = depth(f1);
+    std::size_t depth2 = depth(f2);
+    for (; depth1 > depth2; --depth1) {
+        f1 = m_arena.node(f1)->parent;
+    }
+    for (; depth2 > depth1; --depth2) {
+        f2 = m_arena.node(f2)->parent;
+    }
+    while (f1 != f2) {
+        f1 = m_arena.node(f1)->parent;
+        f2 = m_arena.node(f2)->parent;
+    }
+    return f1;
+}
 
+std::size_t SlicingStructure::depth(Index f) const
+{
+    std::size_t result = 0;
+    for (Index p = m_arena.node(f)->parent; p != FloorplanArena::null; p = m_arena.node(p)->parent) {
+        ++result;
+    }
+    return result;
+}
@@ -2,49 +2,25 @@
 #define SLICING_STRUCTURE_H
 
 #include "Floorplans.h"
+#include "FloorplanArena.h"
+#include "Netlist.h"
 
+class Progress;
+class ThreadPool;
+
+#include <cstdint>
+#include <memory>
 #include <vector>
-#include <map>
-#include <queue>
-#include <functional>
 #include <set>
-
-class CompareX;
-class CompareY;
-
-template<typename T, typename Container = std::vector<T>, typename Compare = std::less<typename Container::value_type> >
-class iterable_priority_queue : public std::priority_queue<T, Container, Compare>
-{
-public:
-    typedef typename Container::iterator iterator;
-    typedef typename Container::const_iterator const_iterator;
-
-    iterator begin() 
-    { 
-        return this->c.begin(); 
-    }
-    
-    iterator end() 
-    { 
-        return this->c.end(); 
-    }
-    
-    const_iterator begin() const 
-    { 
-        return this->c.begin(); 
-    }
-    
-    const_iterator end() const 
-    { 
-        return this->c.end(); 
-    }
-};
-
-
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 class SlicingStructure
 {
 public:
+    typedef std::pair<Module*, Module*> ModulePair;
+
     enum Destination {
         LEFT,
         RIGHT,
@@ -53,59 +29,173 @@ public:
     };
 
     SlicingStructure();     // constructs an empty structure
-    SlicingStructure(const std::vector<Module*>& ); // constructs a slicing structure form list of blocks
+    // Building reports merges to the progress, if any, and throws Cancelled
+    // once it is cancelled; the structure does not keep the progress
+    SlicingStructure(const std::vector<Module*>& , Progress* = 0); // constructs a slicing structure form list of blocks
+    SlicingStructure(const std::vector<Module*>& , ThreadPool& , Progress* = 0); // same, building parts of the tree concurrently
+
+    // Takes a finished tree, e.g. one read from a file, instead of building
+    // it. Leaf i of the arena must hold modules[i].
+    SlicingStructure(const std::vector<Module*>& modules, const FloorplanArena& arena, FloorplanArena::Index root);
+
+    // Takes a snapshot: the copy shares all nodes with the original, and
+    // either of them copies a chunk of nodes only when it changes one of
+    // them, so undo states and what-if runs do not duplicate the tree.
+    // Taking the snapshot costs time proportional to the number of chunks.
     SlicingStructure(const SlicingStructure& SlicingStructure);
-
-    BaseFloorplan* floorplan() const;
-
+    ~SlicingStructure();
+
+    const BaseFloorplan* floorplan() const;
+    const FloorplanArena& arena() const;
+    FloorplanArena::Index root() const;     // FloorplanArena::null if empty
+
+    // Rebuilds every chain of floorplans with the same cut as a balanced
+    // binary tree over the same subtrees, in the same order. The geometry
+    // does not change, but the depth of a row of k blocks drops from k to
+    // about log2(k), so later passes and reduceDistnace walk shorter paths.
+    // Swap decisions are made per floorplan, so results of net migration
+    // and contraction on a balanced tree may differ.
+    void balanceChains();
+
+    // Relayouts the floorplans in depth-first order, so that every subtree
+    // takes a contiguous range of indices starting with its root. Net
+    // migration and contraction then run as linear sweeps over these ranges
+    // instead of following child links. Swaps keep the order, balanceChains
+    // breaks it until the next call. Pointers to floorplans become invalid.
+    void compact();
+
+    // Swaps leave the coordinates below the swapped floorplan stale, so
+    // positions in node rectangles are only valid after this call. Takes
+    // linear time if anything was swapped since the last call.
+    void updateCoordinates() const;
+
+    // Runs net migration and net contraction on the thread pool, forking
+    // subtrees when both children of a floorplan have at least grainSize
+    // leaves. Results are the same as without a pool; 0 runs serially.
+    void setThreadPool(ThreadPool* pool, std::size_t grainSize = 4096);
+
+    // Net migration, net contraction and reduceDistances report visited
+    // nodes or pairs to the progress, and throw Cancelled at the next
+    // checkpoint once it is cancelled from another thread. That leaves the
+    // structure half changed, so cancellable runs are made on a snapshot.
+    // Snapshots do not take the progress over; 0 for none.
+    void setProgress(Progress* progress);
 
     void applyNetMigration(const std::set<Module*>& netModules, const Point& target = Point(0, 0));
+
+    // Reruns the last net migration, recomputing only the paths from leaves
+    // which joined or left the net and the subtrees moved by that.
+    // Falls back to applyNetMigration for the first run, a new target or
+    // after the tree was changed by other operations.
+    void applyNetMigrationIncremental(const std::set<Module*>& netModules, const Point& target = Point(0, 0));
     void applyNetContraction(const std::set<Module*>& netModules);
+
+    // Net migration and contraction for all nets of a netlist at once.
+    // Weights and centers of gravity of every net are collected in a single
+    // upward traversal, and a floorplan is swapped if that decreases the sum
+    // of distances from the centers of its nets to their targets.
+    // The netlist must list modules in the order the structure was built from.
+    void applyNetMigration(const Netlist& netlist, const Point& target = Point(0, 0));
+    void applyNetContraction(const Netlist& netlist);
+
+    // Spatial queries over the blocks. The tree is the index: every floorplan
+    // covers its children, so a query only descends into subtrees reaching
+    // its area, and finding the block at a point takes O(depth), which is
+    // logarithmic after balanceChains. Positions are derived on the way down,
+    // so the answers follow swaps without updateCoordinates. Like targets of
+    // migration, points and areas are in database units, see Geometry.h.
+    Module* moduleAt(const Point& point) const;     // 0 if outside the floorplan
+    std::vector<Module*> modulesIn(const Rectangle& area) const;    // overlapping the inside of area
+    std::vector<Module*> modulesWithin(const Point& center, double radius) const;
+    std::vector<Module*> nearestModules(const Point& point, std::size_t k) const;  // nearest first
+
+    // Position of the module in the list the structure was built from,
+    // which is also its id in a netlist of the structure
+    std::size_t moduleIndex(const Module* module) const;
+
     void reduceDistnace(Module* module1, Module* module2);
-    void moveToSide(BaseFloorplan* root, LeafFloorplan* f, Destination dest, Floorplan::Type);
 
-private:
-    typedef std::priority_queue<BaseFloorplan*, std::vector<BaseFloorplan*>, CompareY> XCoordFloorplans;
-    typedef std::priority_queue<BaseFloorplan*, std::vector<BaseFloorplan*>, CompareX> YCoordFloorplans;
-
-    void fillFloorplanMaps(std::vector<Module*>);
-    void buildSlicingTree();
-    void mergeXFloorplans();
-    void mergeYFloorplans();
-	    
-    bool areVerticalSiblings(BaseFloorplan* f1, BaseFloorplan* f2) const;
-    bool areHorizontalSiblings(BaseFloorplan* f1, BaseFloorplan* f2) const;
-
-    BaseFloorplan* lowestCommonAncestor(BaseFloorplan* root, LeafFloorplan* f1, LeafFloorplan* f2) const;
-    bool findPath(BaseFloorplan* root, LeafFloorplan* f, std::vector<Floorplan*>& path);
-    
-    BaseFloorplan* xMapPop(double x);
-    BaseFloorplan* yMapPop(double y);
+    // Same as calling reduceDistnace for every pair in the given order.
+    // Coordinates are not recalculated, see updateCoordinates.
+    void reduceDistances(const std::vector<ModulePair>& pairs);
 
-    BaseFloorplan* xMapPop(XCoordFloorplans* );
-    BaseFloorplan* yMapPop(YCoordFloorplans* );
+private:
+    typedef FloorplanArena::Index Index;
 
-	void xMapPush(double x, BaseFloorplan* f);
-	void yMapPush(double y, BaseFloorplan* f);
+    SlicingStructure& operator = (const SlicingStructure& );
 
-	void cleanUnusedXKeys();
-	void cleanUnusedYKeys();
+    void buildSlicingTree(const std::vector<Module*>& modules, ThreadPool* pool, Progress* progress);
+    void startProgress(const char* phase, std::uint64_t total);
 
-	void fillXMap();
-	void fillYMap();
+    // Follow parent links, so take O(depth) time
+    Index leafOf(const Module* module) const;
+    Index lowestCommonAncestor(Index f1, Index f2) const;
+    std::size_t depth(Index f) const;
+    void moveToSide(Index root, Index leaf, Destination dest, Floorplan::Type);
 
-    void _applyNetMigrationUpward(BaseFloorplan*, const std::set<Module*>&, const Point&);
-    void _applyNetMigrationDownward(BaseFloorplan*, const std::set<Module*>&, const Point&);
-    void calculateWeights(BaseFloorplan* f, const std::set<Module*>& moduleNets);
-    void applyNetContractionDownward(BaseFloorplan*, const std::set<Module*>&);
-	
-    void print(); // remove
+    // Position of a node while coordinates may be stale: derived from the
+    // highest ancestor with swapped children if there is one
+    Point position(Index f) const;
+    
+    // If dirty is given, only dirty children are visited. The upward pass
+    // adds children of swapped floorplans to moved, the downward pass also
+    // visits children whose coordinates changed.
+    void _applyNetMigrationUpward(Index, const std::set<Module*>&, const Point&,
+                                  const std::unordered_set<Index>* dirty = 0, std::unordered_set<Index>* moved = 0);
+    void _applyNetMigrationDownward(Index, const std::set<Module*>&, const Point&,
+                                    const std::unordered_set<Index>* dirty = 0);
+    void mergeMigrationUpward(Floorplan*, const Point&, std::unordered_set<Index>* moved);
+    void applyNetMigrationDownwardStep(Floorplan*, const Point&);
+    void calculateWeights(Index f, const std::set<Module*>& moduleNets);
+    void mergeWeights(Floorplan*);
+    void applyNetContractionDownward(Index, const std::set<Module*>&);
+
+    // Linear sweeps over the floorplans of a subtree in compact order.
+    // The upward sweep calls step with the index of every node after its
+    // children, the downward sweep with every floorplan before its children.
+    template <typename Step> void sweepUpward(Index f, const Step& step);
+    template <typename Step> void sweepDownward(Index f, const Step& step);
+
+    class NetCenters;
+    class NetTargets;
+    struct NetTerm;
+
+    // Merges the nets of two children, both sorted by net id
+    static void mergeNetTerms(const NetTerm* left, const NetTerm* leftEnd,
+                              const NetTerm* right, const NetTerm* rightEnd,
+                              const Point& offset, std::vector<NetTerm>& result);
+
+    // Without targets only collects the nets, otherwise also swaps children
+    void collectNets(Index f, const Netlist& netlist, NetCenters& nets, const NetTargets* targets);
+    void migrateNetsDownward(Index f, NetCenters& nets, const NetTargets& targets, std::vector<NetTerm>& swapped);
+
+    // Joins operands, the subtrees under one chain, in pairs until two are
+    // left, which become the children of top. Floorplans of the old chain
+    // other than top are taken from slots.
+    void rebuildChain(Index top, Floorplan::Type type, const std::vector<Index>& slots, std::vector<Index>& operands);
+
+    // Subtrees keep their number of leaves when children are swapped
+    void countSubtreeLeaves();
+    bool forkChildren(const Floorplan* f) const;
 
 private:
-    BaseFloorplan* m_floorplan;
-
-    std::map<double, XCoordFloorplans* > m_xFlrp;
-    std::map<double, YCoordFloorplans* > m_yFlrp;
+    FloorplanArena m_arena;
+    Index m_root;
+    std::shared_ptr<const std::unordered_map<const Module*, Index> > m_leaves;  // shared by snapshots
+    mutable bool m_coordinatesValid;
+    bool m_compact;
+
+    // Arguments of the last net migration, for incremental reruns
+    std::set<Module*> m_migrationNet;
+    Point m_migrationTarget;
+    bool m_migrationValid;
+
+    ThreadPool* m_threadPool;
+    std::size_t m_grainSize;
+    Progress* m_progress;
+    // For floorplans, when compact or with a pool. Replaced, never changed
+    // in place, so snapshots share it.
+    std::shared_ptr<const std::vector<std::uint32_t> > m_subtreeLeaves;
 };
 
 #endif
@@ -0,0 +1,423 @@
+#include "SlicingTreeBuilder.h"
+
+#include "Profiler.h"
+#include "Progress.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Merges between reports to the progress
+const std::size_t progressStep = 4096;
+
+// Bits of a coordinate for hashing, equal for equal coordinates but -0
+std::uint64_t bits(Coordinate value)
+{
+#ifdef FLOORPLANNER_INTEGER_COORDINATES
+    return static_cast<std::uint32_t>(value);
+#else
+    std::uint64_t result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+#endif
+}
+
+}
+
+MergeRounds::MergeRounds(std::size_t leaves, std::size_t floorplans)
+    : leafMerged(leaves, never)
+    , floorplanCreated(floorplans, never)
+    , floorplanMerged(floorplans, never)
+{
+}
+
+int MergeRounds::created(Index f) const
+{
+    if (FloorplanArena::isLeafIndex(f)) {
+        return -1;
+    }
+    return floorplanCreated[f];
+}
+
+int MergeRounds::merged(Index f) const
+{
+    if (FloorplanArena::isLeafIndex(f)) {
+        return leafMerged[f & ~FloorplanArena::leafBit];
+    }
+    return floorplanMerged[f];
+}
+
+void MergeRounds::setCreated(Index f, int round)
+{
+    assert(!FloorplanArena::isLeafIndex(f));
+    floorplanCreated[f] = round;
+    floorplanMerged[f] = never;
+}
+
+void MergeRounds::setMerged(Index f, int round)
+{
+    if (FloorplanArena::isLeafIndex(f)) {
+        leafMerged[f & ~FloorplanArena::leafBit] = round;
+    } else {
+        floorplanMerged[f] = round;
+    }
+}
+
+SlicingTreeBuilder::Corner::Corner()
+    : x(0)
+    , y(0)
+{
+}
+
+SlicingTreeBuilder::Corner::Corner(Coordinate x_, Coordinate y_)
+    // Adding zero turns -0 into +0, so equal corners have equal hashes
+    : x(x_ + Coordinate(0))
+    , y(y_ + Coordinate(0))
+{
+}
+
+bool SlicingTreeBuilder::Corner::operator == (const Corner& c) const
+{
+    return x == c.x && y == c.y;
+}
+
+SlicingTreeBuilder::CornerMap::CornerMap()
+    : m_size(0)
+{
+}
+
+void SlicingTreeBuilder::CornerMap::reserve(std::size_t count)
+{
+    // Keep the load factor under one half
+    std::size_t capacity = 16;
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    if (capacity > m_slots.size()) {
+        rehash(capacity);
+    }
+}
+
+std::size_t SlicingTreeBuilder::CornerMap::slot(const Corner& c) const
+{
+    const std::uint64_t x = bits(c.x);
+    const std::uint64_t y = bits(c.y);
+    std::uint64_t h = (x ^ (y * 0x9e3779b97f4a7c15ull)) * 0xff51afd7ed558ccdull;
+    h ^= h >> 32;
+    return static_cast<std::size_t>(h) & (m_slots.size() - 1);
+}
+
+SlicingTreeBuilder::Index SlicingTreeBuilder::CornerMap::find(const Corner& c) const
+{
+    if (m_slots.empty()) {
+        return FloorplanArena::null;
+    }
+    std::size_t mask = m_slots.size() - 1;
+    for (std::size_t i = slot(c); m_slots[i].floorplan != FloorplanArena::null; i = (i + 1) & mask) {
+        if (m_slots[i].corner == c) {
+            return m_slots[i].floorplan;
+        }
+    }
+    return FloorplanArena::null;
+}
+
+void SlicingTreeBuilder::CornerMap::insert(const Corner& c, Index f)
+{
+    if (2 * (m_size + 1) > m_slots.size()) {
+        rehash(m_slots.empty() ? 16 : 2 * m_slots.size());
+    }
+    std::size_t mask = m_slots.size() - 1;
+    std::size_t i = slot(c);
+    for (; m_slots[i].floorplan != FloorplanArena::null; i = (i + 1) & mask) {
+        if (m_slots[i].corner == c) {
+            m_slots[i].floorplan = f;
+            return;
+        }
+    }
+    m_slots[i].corner = c;
+    m_slots[i].floorplan = f;
+    ++m_size;
+}
+
+void SlicingTreeBuilder::CornerMap::erase(const Corner& c, Index f)
+{
+    if (m_slots.empty()) {
+        return;
+    }
+    std::size_t mask = m_slots.size() - 1;
+    std::size_t i = slot(c);
+    for (; m_slots[i].floorplan != FloorplanArena::null; i = (i + 1) & mask) {
+        if (m_slots[i].corner == c) {
+            break;
+        }
+    }
+    if (m_slots[i].floorplan != f) {
+        return;
+    }
+
+    // Shift following entries back, so that no probe sequence is broken
+    std::size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (m_slots[j].floorplan == FloorplanArena::null) {
+            break;
+        }
+        std::size_t home = slot(m_slots[j].corner);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m_slots[i] = m_slots[j];
+            i = j;
+        }
+    }
+    m_slots[i].floorplan = FloorplanArena::null;
+    --m_size;
+}
+
+std::size_t SlicingTreeBuilder::CornerMap::size() const
+{
+    return m_size;
+}
+
+SlicingTreeBuilder::Index SlicingTreeBuilder::CornerMap::any() const
+{
+    std::vector<Slot>::const_iterator it;
+    for (it = m_slots.begin(); it != m_slots.end(); ++it) {
+        if (it->floorplan != FloorplanArena::null) {
+            return it->floorplan;
+        }
+    }
+    return FloorplanArena::null;
+}
+
+void SlicingTreeBuilder::CornerMap::clear()
+{
+    m_slots.clear();
+    m_size = 0;
+}
+
+void SlicingTreeBuilder::CornerMap::rehash(std::size_t capacity)
+{
+    std::vector<Slot> old;
+    old.swap(m_slots);
+    Slot empty;
+    empty.floorplan = FloorplanArena::null;
+    m_slots.assign(capacity, empty);
+    m_size = 0;
+    std::vector<Slot>::const_iterator it;
+    for (it = old.begin(); it != old.end(); ++it) {
+        if (it->floorplan != FloorplanArena::null) {
+            insert(it->corner, it->floorplan);
+        }
+    }
+}
+
+SlicingTreeBuilder::SlicingTreeBuilder(FloorplanArena& arena)
+    : m_arena(arena)
+    , m_rounds(0)
+    , m_progress(0)
+    , m_nextSlot(FloorplanArena::null)
+    , m_round(0)
+{
+}
+
+void SlicingTreeBuilder::recordRounds(MergeRounds* rounds)
+{
+    m_rounds = rounds;
+}
+
+void SlicingTreeBuilder::setProgress(Progress* progress)
+{
+    m_progress = progress;
+}
+
+void SlicingTreeBuilder::placeAt(Index firstFloorplan)
+{
+    m_nextSlot = firstFloorplan;
+}
+
+SlicingTreeBuilder::Index SlicingTreeBuilder::build(const std::vector<Index>& nodes)
+{
+    if (nodes.empty()) {
+        return FloorplanArena::null;
+    }
+
+    {
+        ScopedTimer timer("corner map fill");
+        m_bottomLeft.reserve(nodes.size());
+        m_topLeft.reserve(nodes.size());
+        m_bottomRight.reserve(nodes.size());
+        std::vector<Index>::const_iterator it;
+        for (it = nodes.begin(); it != nodes.end(); ++it) {
+            insert(*it);
+        }
+    }
+
+    // Floorplans which may have siblings of the given kind. Merged runs are
+    // maximal, so only floorplans created by the other kind of round since
+    // the last round of this kind can start new runs.
+    std::vector<Index> pendingX(nodes);
+    std::vector<Index> pendingY(nodes);
+    std::vector<Index> createdX;
+    std::vector<Index> createdY;
+    m_round = 0;
+    while (true) {
+        createdX.clear();
+        mergeRuns(pendingX, Floorplan::H, createdX);
+        if (m_bottomLeft.size() == 1) {
+            break;
+        }
+        pendingY.insert(pendingY.end(), createdX.begin(), createdX.end());
+
+        ++m_round;
+        createdY.clear();
+        mergeRuns(pendingY, Floorplan::V, createdY);
+        if (m_bottomLeft.size() == 1) {
+            break;
+        }
+        pendingY.clear();
+
+        if (createdX.empty() && createdY.empty()) {
+            throw std::runtime_error("Blocks do not form a slicing floorplan!");
+        }
+        pendingX.swap(createdY);
+        ++m_round;
+    }
+
+    Index root = m_bottomLeft.any();
+    m_bottomLeft.clear();
+    m_topLeft.clear();
+    m_bottomRight.clear();
+    return root;
+}
+
+void SlicingTreeBuilder::mergeRuns(const std::vector<Index>& pending, Floorplan::Type type, std::vector<Index>& created)
+{
+    ScopedTimer timer(type == Floorplan::H ? "x merge round" : "y merge round");
+    Profiler::count(Profiler::MergeRounds);
+
+    std::vector<Index>::const_iterator it;
+    for (it = pending.begin(); it != pending.end(); ++it) {
+        // Skip floorplans already merged into a run of this round
+        if (!isAlive(*it)) {
+            continue;
+        }
+
+        // Go back to the first floorplan of the run
+        Index current = *it;
+        Index previous = predecessor(current, type);
+        while (previous != FloorplanArena::null) {
+            current = previous;
+            previous = predecessor(current, type);
+        }
+
+        // Merge the run from its beginning, one sibling at a time
+        Index next = successor(current, type);
+        while (next != FloorplanArena::null) {
+            Index merged = merge(current, next, type);
+            erase(current);
+            erase(next);
+            insert(merged);
+            created.push_back(merged);
+            current = merged;
+            next = successor(current, type);
+            if (0 != m_progress && created.size() % progressStep == 0) {
+                m_progress->advance(progressStep);
+            }
+        }
+    }
+    if (0 != m_progress) {
+        m_progress->advance(created.size() % progressStep);
+    }
+}
+
+SlicingTreeBuilder::Index SlicingTreeBuilder::merge(Index left, Index right, Floorplan::Type type)
+{
+    Index merged;
+    if (m_nextSlot == FloorplanArena::null) {
+        merged = m_arena.createFloorplan(left, right, type);
+    } else {
+        merged = m_nextSlot++;
+        m_arena.createFloorplanAt(merged, left, right, type);
+    }
+    if (m_rounds) {
+        m_rounds->setCreated(merged, m_round);
+        m_rounds->setMerged(left, m_round);
+        m_rounds->setMerged(right, m_round);
+    }
+    return merged;
+}
+
+SlicingTreeBuilder::Index SlicingTreeBuilder::predecessor(Index f, Floorplan::Type type) const
+{
+    const Rectangle& rect = m_arena.node(f)->rect;
+    if (type == Floorplan::H) {
+        Index below = m_topLeft.find(Corner(rect.left(), rect.bottom()));
+        if (below != FloorplanArena::null && areHorizontalSiblings(m_arena.node(below), m_arena.node(f))) {
+            return below;
+        }
+    } else {
+        Index before = m_bottomRight.find(Corner(rect.left(), rect.bottom()));
+        if (before != FloorplanArena::null && areVerticalSiblings(m_arena.node(before), m_arena.node(f))) {
+            return before;
+        }
+    }
+    return FloorplanArena::null;
+}
+
+SlicingTreeBuilder::Index SlicingTreeBuilder::successor(Index f, Floorplan::Type type) const
+{
+    const Rectangle& rect = m_arena.node(f)->rect;
+    Index next;
+    if (type == Floorplan::H) {
+        next = m_bottomLeft.find(Corner(rect.left(), rect.top()));
+        if (next != FloorplanArena::null && areHorizontalSiblings(m_arena.node(f), m_arena.node(next))) {
+            return next;
+        }
+    } else {
+        next = m_bottomLeft.find(Corner(rect.right(), rect.bottom()));
+        if (next != FloorplanArena::null && areVerticalSiblings(m_arena.node(f), m_arena.node(next))) {
+            return next;
+        }
+    }
+    return FloorplanArena::null;
+}
+
+void SlicingTreeBuilder::insert(Index f)
+{
+    const Rectangle& rect = m_arena.node(f)->rect;
+    m_bottomLeft.insert(Corner(rect.left(), rect.bottom()), f);
+    m_topLeft.insert(Corner(rect.left(), rect.top()), f);
+    m_bottomRight.insert(Corner(rect.right(), rect.bottom()), f);
+}
+
+void SlicingTreeBuilder::erase(Index f)
+{
+    const Rectangle& rect = m_arena.node(f)->rect;
+    m_bottomLeft.erase(Corner(rect.left(), rect.bottom()), f);
+    m_topLeft.erase(Corner(rect.left(), rect.top()), f);
+    m_bottomRight.erase(Corner(rect.right(), rect.bottom()), f);
+}
+
+bool SlicingTreeBuilder::isAlive(Index f) const
+{
+    const Rectangle& rect = m_arena.node(f)->rect;
+    return m_bottomLeft.find(Corner(rect.left(), rect.bottom())) == f;
+}
+
+bool SlicingTreeBuilder::areHorizontalSiblings(const BaseFloorplan* f1, const BaseFloorplan* f2) const
+{
+    if (f1->rect.left() == f2->rect.left() && f1->rect.right() == f2->rect.right() && f1->rect.top() == f2->rect.bottom()) {
+        return true;
+    }
+    return false;
+}
+
+bool SlicingTreeBuilder::areVerticalSiblings(const BaseFloorplan* f1, const BaseFloorplan* f2) const
+{
+    if (f1->rect.bottom() == f2->rect.bottom() && f1->rect.top() == f2->rect.top() && f2->rect.left() == f1->rect.right()) {
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,130 @@
+#ifndef SLICING_TREE_BUILDER_H
+#define SLICING_TREE_BUILDER_H
+
+#include "FloorplanArena.h"
+
+class Progress;
+
+#include <climits>
+#include <cstddef>
+#include <vector>
+
+// Rounds in which floorplans were created and merged into their parents.
+// Rounds are counted from 0; even rounds merge horizontal siblings and odd
+// rounds vertical ones. Leaves are created in round -1.
+struct MergeRounds
+{
+    typedef FloorplanArena::Index Index;
+
+    static constexpr int never = INT_MAX;
+
+    MergeRounds(std::size_t leaves, std::size_t floorplans);
+
+    int created(Index f) const;
+    int merged(Index f) const;
+    void setCreated(Index f, int round);
+    void setMerged(Index f, int round);
+
+    std::vector<int> leafMerged;
+    std::vector<int> floorplanCreated;
+    std::vector<int> floorplanMerged;
+};
+
+// Builds a slicing tree bottom-up from a set of floorplans.
+// Like the original map-based construction it alternates rounds which
+// merge runs of horizontal siblings into H floorplans and runs of
+// vertical siblings into V floorplans, giving the same tree.
+// Siblings are found through hashed corner coordinates, and a round only
+// looks at runs containing floorplans created since the last round of the
+// same kind, so construction is close to linear in the number of blocks.
+class SlicingTreeBuilder
+{
+public:
+    typedef FloorplanArena::Index Index;
+
+    SlicingTreeBuilder(FloorplanArena& arena);
+
+    // Records the rounds of all merges made by build
+    void recordRounds(MergeRounds* rounds);
+
+    // Reports merges to the progress, which may cancel the build
+    void setProgress(Progress* progress);
+
+    // Makes build fill floorplans reserved in the arena, starting from the
+    // given index, instead of appending new ones
+    void placeAt(Index firstFloorplan);
+
+    // Returns the root of the tree, or FloorplanArena::null for no nodes.
+    // Throws std::runtime_error if the nodes can not be merged to one, and
+    // Cancelled if the progress was cancelled.
+    Index build(const std::vector<Index>& nodes);
+
+private:
+    struct Corner
+    {
+        Coordinate x;
+        Coordinate y;
+
+        Corner();
+        Corner(Coordinate x_, Coordinate y_);
+        bool operator == (const Corner& c) const;
+    };
+
+    // Open addressing hash table from corners to floorplans
+    class CornerMap
+    {
+    public:
+        CornerMap();
+
+        void reserve(std::size_t count);
+        Index find(const Corner& c) const;
+        void insert(const Corner& c, Index f);
+        // Removes the corner only if it belongs to the given floorplan
+        void erase(const Corner& c, Index f);
+        std::size_t size() const;
+        Index any() const;
+        void clear();
+
+    private:
+        struct Slot
+        {
+            Corner corner;
+            Index floorplan;
+        };
+
+        std::size_t slot(const Corner& c) const;
+        void rehash(std::size_t capacity);
+
+        std::vector<Slot> m_slots;
+        std::size_t m_size;
+    };
+
+    Index merge(Index left, Index right, Floorplan::Type type);
+    void insert(Index f);
+    void erase(Index f);
+    bool isAlive(Index f) const;
+
+    Index predecessor(Index f, Floorplan::Type type) const;
+    Index successor(Index f, Floorplan::Type type) const;
+
+    // Merges every run of siblings which contains one of pending nodes
+    // and appends the merged floorplans to created
+    void mergeRuns(const std::vector<Index>& pending, Floorplan::Type type, std::vector<Index>& created);
+
+    bool areHorizontalSiblings(const BaseFloorplan* f1, const BaseFloorplan* f2) const;
+    bool areVerticalSiblings(const BaseFloorplan* f1, const BaseFloorplan* f2) const;
+
+private:
+    FloorplanArena& m_arena;
+    MergeRounds* m_rounds;
+    Progress* m_progress;
+    Index m_nextSlot;
+    int m_round;
+
+    // Alive floorplans by their bottom left, top left and bottom right corners
+    CornerMap m_bottomLeft;
+    CornerMap m_topLeft;
+    CornerMap m_bottomRight;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SWAP_EVALUATION_H
+#define SWAP_EVALUATION_H
+
+#include "Floorplans.h"
+
+// Centers of gravity of a floorplan with its children in the current order
+// and with the children swapped
+struct SwapCenters
+{
+    Point merged;
+    Point swapped;
+};
+
+// Evaluates both orders directly from the children. Sizes are the widths
+// of the children of a V floorplan or the heights of the children of an H
+// one. A child without weight does not move the center of the other one.
+inline SwapCenters evaluateSwap(double leftSize, double rightSize,
+                                double leftWeight, double rightWeight,
+                                const Point& leftCenter, const Point& rightCenter,
+                                Floorplan::Type type)
+{
+    // Swapped children take each other's place along the cut direction
+    Point swappedLeft(rightCenter);
+    Point swappedRight(leftCenter);
+    if (type == Floorplan::V) {
+        swappedLeft.x -= leftSize;
+        swappedRight.x += rightSize;
+    } else {
+        swappedLeft.y -= leftSize;
+        swappedRight.y += rightSize;
+    }
+
+    // c = c1 * w1 / (w1 + w2) + c2 * w2 / (w1 + w2)
+    SwapCenters result;
+    if (leftWeight == 0) {
+        result.merged = rightCenter;
+        result.swapped = swappedLeft;
+    } else if (rightWeight == 0) {
+        result.merged = leftCenter;
+        result.swapped = swappedRight;
+    } else {
+        double coef1 = leftWeight / (leftWeight + rightWeight);
+        double coef2 = rightWeight / (leftWeight + rightWeight);
+        result.merged.x = coef1 * leftCenter.x + coef2 * rightCenter.x;
+        result.merged.y = coef1 * leftCenter.y + coef2 * rightCenter.y;
+        double swappedCoef1 = rightWeight / (rightWeight + leftWeight);
+        double swappedCoef2 = leftWeight / (rightWeight + leftWeight);
+        result.swapped.x = swappedCoef1 * swappedLeft.x + swappedCoef2 * swappedRight.x;
+        result.swapped.y = swappedCoef1 * swappedLeft.y + swappedCoef2 * swappedRight.y;
+    }
+    return result;
+}
+
+inline SwapCenters evaluateSwap(const BaseFloorplan* left, const BaseFloorplan* right, Floorplan::Type type)
+{
+    if (type == Floorplan::V) {
+        return evaluateSwap(left->rect.width(), right->rect.width(), left->weight, right->weight,
+                            left->centerOfGravity, right->centerOfGravity, type);
+    }
+    return evaluateSwap(left->rect.height(), right->rect.height(), left->weight, right->weight,
+                        left->centerOfGravity, right->centerOfGravity, type);
+}
+
+#endif
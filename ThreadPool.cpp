@@ -0,0 +1,179 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Pool and worker index of the current thread, if it is a pool worker
+thread_local const ThreadPool* currentPool = 0;
+thread_local int currentIndex = -1;
+
+}
+
+ThreadPool::TaskGroup::TaskGroup(ThreadPool& pool)
+    : m_pool(pool)
+    , m_pending(0)
+{
+}
+
+ThreadPool::TaskGroup::~TaskGroup()
+{
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void ThreadPool::TaskGroup::run(const Task& task)
+{
+    ++m_pending;
+    Entry entry;
+    entry.task = task;
+    entry.group = this;
+    m_pool.push(entry);
+}
+
+void ThreadPool::TaskGroup::wait()
+{
+    // Help with queued tasks instead of blocking
+    while (m_pending > 0) {
+        Entry entry;
+        if (m_pool.pop(entry)) {
+            m_pool.execute(entry);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        error = m_error;
+        m_error = std::exception_ptr();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+ThreadPool::ThreadPool(unsigned threads)
+    : m_queued(0)
+    , m_nextWorker(0)
+    , m_stop(false)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        m_workers.push_back(new Worker());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        m_threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_all();
+    for (std::size_t i = 0; i < m_threads.size(); ++i) {
+        m_threads[i].join();
+    }
+    for (std::size_t i = 0; i < m_workers.size(); ++i) {
+        delete m_workers[i];
+    }
+}
+
+unsigned ThreadPool::size() const
+{
+    return static_cast<unsigned>(m_workers.size());
+}
+
+int ThreadPool::currentWorker() const
+{
+    return (currentPool == this) ? currentIndex : -1;
+}
+
+void ThreadPool::push(const Entry& entry)
+{
+    // Workers queue their own tasks, other threads spread them around
+    int self = currentWorker();
+    unsigned target = (self >= 0) ? static_cast<unsigned>(self) : (m_nextWorker++ % size());
+    {
+        std::lock_guard<std::mutex> lock(m_workers[target]->mutex);
+        m_workers[target]->tasks.push_back(entry);
+    }
+    ++m_queued;
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeUp.notify_one();
+}
+
+bool ThreadPool::pop(Entry& entry)
+{
+    if (m_queued == 0) {
+        return false;
+    }
+
+    // Newest task of the own deque first
+    int self = currentWorker();
+    if (self >= 0) {
+        Worker* worker = m_workers[self];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->tasks.empty()) {
+            entry = worker->tasks.back();
+            worker->tasks.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+
+    // Otherwise steal the oldest task of another worker
+    unsigned start = (self >= 0) ? static_cast<unsigned>(self) + 1 : 0;
+    for (unsigned i = 0; i < size(); ++i) {
+        Worker* worker = m_workers[(start + i) % size()];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->tasks.empty()) {
+            entry = worker->tasks.front();
+            worker->tasks.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(Entry& entry)
+{
+    try {
+        entry.task();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(entry.group->m_errorMutex);
+        if (!entry.group->m_error) {
+            entry.group->m_error = std::current_exception();
+        }
+    }
+    --entry.group->m_pending;
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+    currentPool = this;
+    currentIndex = static_cast<int>(index);
+    while (true) {
+        Entry entry;
+        if (pop(entry)) {
+            execute(entry);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeUp.wait(lock, [this] { return m_stop || m_queued > 0; });
+        if (m_stop && m_queued == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool for fork-join parallelism.
+// Every worker has its own task deque: it runs its newest tasks first and
+// steals the oldest tasks of other workers when it runs out of work.
+// Threads waiting for a TaskGroup keep running queued tasks, so groups can
+// be nested without blocking the workers.
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    class TaskGroup
+    {
+    public:
+        TaskGroup(ThreadPool& pool);
+        ~TaskGroup();
+
+        void run(const Task& task);
+
+        // Waits for all tasks of the group and rethrows the first exception
+        // thrown by one of them
+        void wait();
+
+    private:
+        TaskGroup(const TaskGroup& );
+        TaskGroup& operator = (const TaskGroup& );
+
+        friend class ThreadPool;
+
+        ThreadPool& m_pool;
+        std::atomic<std::size_t> m_pending;
+        std::mutex m_errorMutex;
+        std::exception_ptr m_error;
+    };
+
+    // Zero threads means one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    unsigned size() const;
+
+private:
+    ThreadPool(const ThreadPool& );
+    ThreadPool& operator = (const ThreadPool& );
+
+    struct Entry
+    {
+        Task task;
+        TaskGroup* group;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Entry> tasks;
+    };
+
+    void push(const Entry& entry);
+    bool pop(Entry& entry);
+    void execute(Entry& entry);
+    void workerLoop(unsigned index);
+    int currentWorker() const;
+
+private:
+    std::vector<Worker*> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<std::size_t> m_queued;
+    std::atomic<unsigned> m_nextWorker;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUp;
+    bool m_stop;
+};
+
+#endif
@@ -0,0 +1,321 @@
+#include "FloorplanGenerator.h"
+#include "InputOutputManager.h"
+#include "SlicingStructure.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+const char* usage =
+    "Usage: floorplanner_bench [options]\n"
+    "\n"
+    "Generates random floorplans of growing sizes and times every phase on\n"
+    "them: parsing, building, net migration, net contraction and distance\n"
+    "reduction, in the order the tree was built and after compact, and\n"
+    "writing. Prints the time, the throughput in blocks per second and the\n"
+    "peak memory of the process after each size.\n"
+    "\n"
+    "Options:\n"
+    "  --sizes N,...    block counts, 1000,10000,100000,1000000 by default\n"
+    "  --threads N      worker threads, 0 for one per hardware thread (default),\n"
+    "                   1 to run serially\n"
+    "  --skew S         skew of the generated cuts, 0.2 by default\n"
+    "  --nets N         number of nets, 100 by default\n"
+    "  --net-size N     blocks of every net, 16 by default\n"
+    "  --pairs N        module pairs of distance reduction, 1000 by default\n"
+    "  --seed N         seed of the generator, 1 by default\n"
+    "  --dir DIR        directory of the generated files, . by default\n"
+    "  --keep           keep the generated files\n"
+    "  -h, --help       show this message\n";
+
+class UsageError
+    : public std::runtime_error
+{
+public:
+    UsageError(const std::string& message)
+        : std::runtime_error(message)
+    {
+    }
+};
+
+struct Options
+{
+    Options()
+        : threads(0)
+        , skew(0.2)
+        , netCount(100)
+        , netSize(16)
+        , pairCount(1000)
+        , seed(1)
+        , directory(".")
+        , keep(false)
+    {
+        sizes.push_back(1000);
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+        sizes.push_back(1000000);
+    }
+
+    std::vector<std::size_t> sizes;
+    unsigned threads;
+    double skew;
+    std::size_t netCount;
+    std::size_t netSize;
+    std::size_t pairCount;
+    unsigned seed;
+    std::string directory;
+    bool keep;
+};
+
+unsigned long parseCount(const std::string& option, const char* value)
+{
+    char* end = 0;
+    unsigned long result = std::strtoul(value, &end, 10);
+    if (end == value || *end != '\0') {
+        throw UsageError(option + " expects a number");
+    }
+    return result;
+}
+
+std::vector<std::size_t> parseCounts(const std::string& option, const char* value)
+{
+    std::vector<std::size_t> result;
+    const char* p = value;
+    while (true) {
+        char* end = 0;
+        unsigned long count = std::strtoul(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0') || count == 0) {
+            throw UsageError(option + " expects positive numbers separated by commas");
+        }
+        result.push_back(count);
+        if (*end == '\0') {
+            return result;
+        }
+        p = end + 1;
+    }
+}
+
+// Returns false if only the help was asked for
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (arg == "--sizes" || arg == "--threads" || arg == "--skew" || arg == "--nets"
+                   || arg == "--net-size" || arg == "--pairs" || arg == "--seed" || arg == "--dir") {
+            if (i + 1 == argc) {
+                throw UsageError(arg + " expects a value");
+            }
+            const char* value = argv[++i];
+            if (arg == "--sizes") {
+                options.sizes = parseCounts(arg, value);
+            } else if (arg == "--threads") {
+                options.threads = static_cast<unsigned>(parseCount(arg, value));
+            } else if (arg == "--skew") {
+                char* end = 0;
+                options.skew = std::strtod(value, &end);
+                if (end == value || *end != '\0') {
+                    throw UsageError(arg + " expects a number");
+                }
+            } else if (arg == "--nets") {
+                options.netCount = parseCount(arg, value);
+            } else if (arg == "--net-size") {
+                options.netSize = parseCount(arg, value);
+            } else if (arg == "--pairs") {
+                options.pairCount = parseCount(arg, value);
+            } else if (arg == "--seed") {
+                options.seed = static_cast<unsigned>(parseCount(arg, value));
+            } else {
+                options.directory = value;
+            }
+        } else {
+            throw UsageError("unknown argument " + arg);
+        }
+    }
+    return true;
+}
+
+// Peak resident memory of the process in bytes, 0 if unknown
+std::size_t peakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Prints the time of a phase over the given number of blocks
+class PhaseTimer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    PhaseTimer(std::size_t blocks)
+        : m_blocks(blocks)
+        , m_last(Clock::now())
+    {
+    }
+
+    void restart()
+    {
+        m_last = Clock::now();
+    }
+
+    void finish(const std::string& phase)
+    {
+        const Clock::time_point now = Clock::now();
+        const double ms = std::chrono::duration<double, std::milli>(now - m_last).count();
+        const double rate = ms > 0 ? m_blocks / ms / 1000 : 0;
+        std::printf("%10zu  %-18s %10.1f ms %10.2f Mblocks/s\n", m_blocks, phase.c_str(), ms, rate);
+        std::fflush(stdout);
+        m_last = now;
+    }
+
+private:
+    std::size_t m_blocks;
+    Clock::time_point m_last;
+};
+
+// Runs the algorithms on a snapshot of the built structure, so that both
+// orders of floorplans start from the same tree
+void runSteps(const SlicingStructure& built, bool compact, ThreadPool* pool,
+              const Netlist& netlist, const std::vector<SlicingStructure::ModulePair>& pairs,
+              PhaseTimer& timer, const std::string& outputName)
+{
+    const std::string suffix = compact ? " (compact)" : "";
+    timer.restart();
+    SlicingStructure structure(built);
+    if (compact) {
+        structure.compact();
+        timer.finish("compact");
+    }
+    structure.setThreadPool(pool);
+
+    timer.restart();
+    structure.applyNetMigration(netlist);
+    timer.finish("migrate" + suffix);
+    structure.applyNetContraction(netlist);
+    timer.finish("contract" + suffix);
+    structure.reduceDistances(pairs);
+    structure.updateCoordinates();
+    timer.finish("reduce" + suffix);
+
+    if (!outputName.empty()) {
+        writeFloorplan(outputName, structure, Netlist());
+        timer.finish("write");
+    }
+}
+
+void runSize(std::size_t blocks, const Options& options, ThreadPool* pool)
+{
+    const std::string base = options.directory + "/bench_" + std::to_string(blocks);
+    const std::string inputName = base + ".txt";
+    const std::string outputName = base + "_out.txt";
+
+    PhaseTimer timer(blocks);
+    GeneratorOptions generator;
+    generator.blockCount = blocks;
+    generator.seed = options.seed;
+    generator.skew = options.skew;
+    generator.netCount = options.netCount;
+    generator.netSize = options.netSize;
+    generateFloorplan(inputName, generator);
+    timer.finish("generate");
+
+    std::pair<std::vector<Module*>, Netlist> design = readDesign(inputName, pool);
+    timer.finish("parse");
+    std::unique_ptr<SlicingStructure> built;
+    if (pool) {
+        built.reset(new SlicingStructure(design.first, *pool));
+    } else {
+        built.reset(new SlicingStructure(design.first));
+    }
+    timer.finish("build");
+
+    std::vector<SlicingStructure::ModulePair> pairs;
+    if (blocks > 1) {
+        std::mt19937_64 random(options.seed);
+        std::uniform_int_distribution<std::size_t> anyModule(0, blocks - 1);
+        while (pairs.size() < options.pairCount) {
+            std::size_t a = anyModule(random);
+            std::size_t b = anyModule(random);
+            if (a != b) {
+                pairs.push_back(SlicingStructure::ModulePair(design.first[a], design.first[b]));
+            }
+        }
+    }
+
+    runSteps(*built, false, pool, design.second, pairs, timer, "");
+    runSteps(*built, true, pool, design.second, pairs, timer, outputName);
+
+    built.reset();
+    for (std::size_t i = 0; i < design.first.size(); ++i) {
+        delete design.first[i];
+    }
+    if (!options.keep) {
+        std::remove(inputName.c_str());
+        std::remove(outputName.c_str());
+    }
+    std::printf("%10zu  %-18s %10.1f MB\n", blocks, "peak memory", peakMemory() / (1024.0 * 1024.0));
+    std::fflush(stdout);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            std::fputs(usage, stdout);
+            return 0;
+        }
+        std::unique_ptr<ThreadPool> pool;
+        if (options.threads != 1) {
+            pool.reset(new ThreadPool(options.threads));
+        }
+        for (std::size_t i = 0; i < options.sizes.size(); ++i) {
+            runSize(options.sizes[i], options, pool.get());
+        }
+        return 0;
+    } catch (const UsageError& e) {
+        std::fprintf(stderr, "floorplanner_bench: %s\n\n%s", e.what(), usage);
+        return 2;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "floorplanner_bench: %s\n", e.what());
+        return 1;
+    }
+}
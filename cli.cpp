@@ -0,0 +1,299 @@
+#include "InputOutputManager.h"
+#include "Profiler.h"
+#include "SlicingStructure.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char* usage =
+    "Usage: floorplanner_cli [options] <input> [<output>]\n"
+    "\n"
+    "Loads a block file or a binary floorplan, runs the steps in the given\n"
+    "order and writes the result. Outputs ending in .sfp are written as\n"
+    "binary floorplans. Timings of all phases are printed to stderr.\n"
+    "\n"
+    "Steps:\n"
+    "  --migrate        net migration\n"
+    "  --contract       net contraction\n"
+    "  --reduce         reduce distance of the two marked modules\n"
+    "\n"
+    "Options:\n"
+    "  --target X,Y     target point of net migration, 0,0 by default\n"
+    "  --balance        balance chains of cuts before the steps\n"
+    "  --no-compact     keep the floorplans in the order they were built\n"
+    "  --threads N      worker threads, 0 for one per hardware thread (default),\n"
+    "                   1 to run serially\n"
+    "  --grain N        leaves of the smallest subtrees run as a task, 4096 by default\n"
+    "  --delta          delta coordinates in binary output, if they are integral\n"
+    "  --profile FILE   write times of the phases and operation counts as JSON\n"
+    "  --trace FILE     write the timed scopes of all threads as a Chrome trace\n"
+    "                   (chrome://tracing, Perfetto)\n"
+    "  -h, --help       show this message\n";
+
+class UsageError
+    : public std::runtime_error
+{
+public:
+    UsageError(const std::string& message)
+        : std::runtime_error(message)
+    {
+    }
+};
+
+struct Options
+{
+    Options()
+        : target(0, 0)
+        , balance(false)
+        , compact(true)
+        , threads(0)
+        , grainSize(4096)
+        , delta(false)
+    {
+    }
+
+    std::string input;
+    std::string output;
+    std::vector<std::string> steps;
+    Point target;
+    bool balance;
+    bool compact;
+    unsigned threads;
+    std::size_t grainSize;
+    bool delta;
+    std::string profile;
+    std::string trace;
+};
+
+unsigned long parseCount(const std::string& option, const char* value)
+{
+    char* end = 0;
+    unsigned long result = std::strtoul(value, &end, 10);
+    if (end == value || *end != '\0') {
+        throw UsageError(option + " expects a number");
+    }
+    return result;
+}
+
+Point parsePoint(const std::string& option, const char* value)
+{
+    char* end = 0;
+    double x = std::strtod(value, &end);
+    if (end == value || *end != ',') {
+        throw UsageError(option + " expects X,Y");
+    }
+    const char* rest = end + 1;
+    double y = std::strtod(rest, &end);
+    if (end == rest || *end != '\0') {
+        throw UsageError(option + " expects X,Y");
+    }
+    return Point(x, y);
+}
+
+// Returns false if only the help was asked for
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--migrate" || arg == "--contract" || arg == "--reduce") {
+            options.steps.push_back(arg.substr(2));
+        } else if (arg == "--balance") {
+            options.balance = true;
+        } else if (arg == "--no-compact") {
+            options.compact = false;
+        } else if (arg == "--delta") {
+            options.delta = true;
+        } else if (arg == "--target" || arg == "--threads" || arg == "--grain" || arg == "--profile" || arg == "--trace") {
+            if (i + 1 == argc) {
+                throw UsageError(arg + " expects a value");
+            }
+            const char* value = argv[++i];
+            if (arg == "--target") {
+                // The tree is in database units, see Geometry.h
+                const Point target = parsePoint(arg, value);
+                options.target = Point(toDatabaseUnits(target.x), toDatabaseUnits(target.y));
+            } else if (arg == "--threads") {
+                options.threads = static_cast<unsigned>(parseCount(arg, value));
+            } else if (arg == "--grain") {
+                options.grainSize = parseCount(arg, value);
+            } else if (arg == "--profile") {
+                options.profile = value;
+            } else {
+                options.trace = value;
+            }
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw UsageError("unknown option " + arg);
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty() || files.size() > 2) {
+        throw UsageError("expected an input and an optional output file");
+    }
+    options.input = files[0];
+    if (files.size() == 2) {
+        options.output = files[1];
+    }
+    return true;
+}
+
+bool endsWith(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Wall clock time of the phases, printed as they finish
+class PhaseTimer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    PhaseTimer()
+        : m_start(Clock::now())
+        , m_last(m_start)
+    {
+    }
+
+    void finish(const std::string& phase)
+    {
+        const Clock::time_point now = Clock::now();
+        std::fprintf(stderr, "%-12s %10.1f ms\n", phase.c_str(), milliseconds(m_last, now));
+        m_last = now;
+    }
+
+    void total()
+    {
+        std::fprintf(stderr, "%-12s %10.1f ms\n", "total", milliseconds(m_start, Clock::now()));
+    }
+
+private:
+    static double milliseconds(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    Clock::time_point m_start;
+    Clock::time_point m_last;
+};
+
+int run(const Options& options)
+{
+    Profiler::setEnabled(!options.profile.empty() || !options.trace.empty());
+    PhaseTimer timer;
+    std::unique_ptr<ThreadPool> pool;
+    if (options.threads != 1) {
+        pool.reset(new ThreadPool(options.threads));
+    }
+
+    // Binary floorplans come with their slicing tree, block files are built
+    std::pair<std::vector<Module*>, Netlist> design;
+    std::unique_ptr<SlicingStructure> structure;
+    if (isBinaryDesign(options.input)) {
+        structure.reset(readBinaryDesign(options.input, design));
+        timer.finish("load");
+    } else {
+        design = readDesign(options.input, pool.get());
+        timer.finish("parse");
+        if (pool) {
+            structure.reset(new SlicingStructure(design.first, *pool));
+        } else {
+            structure.reset(new SlicingStructure(design.first));
+        }
+        timer.finish("build");
+    }
+    std::fprintf(stderr, "%zu modules, %zu nets\n", design.first.size(), design.second.netCount());
+
+    // Modules of any net, as marked in the GUI
+    std::set<Module*> netModules;
+    const Netlist& netlist = design.second;
+    for (Netlist::Id net = 0; net < netlist.netCount(); ++net) {
+        for (const Netlist::Id* it = netlist.netModulesBegin(net); it != netlist.netModulesEnd(net); ++it) {
+            netModules.insert(design.first[*it]);
+        }
+    }
+
+    if (options.balance) {
+        structure->balanceChains();
+        timer.finish("balance");
+    }
+    if (options.compact) {
+        structure->compact();
+        timer.finish("compact");
+    }
+    structure->setThreadPool(pool.get(), options.grainSize);
+
+    std::vector<std::string>::const_iterator step;
+    for (step = options.steps.begin(); step != options.steps.end(); ++step) {
+        if (*step == "migrate") {
+            if (netlist.netCount() > 1) {
+                structure->applyNetMigration(netlist, options.target);
+            } else {
+                structure->applyNetMigration(netModules, options.target);
+            }
+        } else if (*step == "contract") {
+            if (netlist.netCount() > 1) {
+                structure->applyNetContraction(netlist);
+            } else {
+                structure->applyNetContraction(netModules);
+            }
+        } else {
+            if (netModules.size() != 2) {
+                throw std::runtime_error("Reduce distance needs exactly two marked modules");
+            }
+            structure->reduceDistnace(*netModules.begin(), *netModules.rbegin());
+        }
+        timer.finish(*step);
+    }
+
+    if (!options.output.empty()) {
+        if (endsWith(options.output, ".sfp")) {
+            writeBinaryDesign(options.output, *structure, netlist, options.delta);
+        } else {
+            writeFloorplan(options.output, *structure, netlist);
+        }
+        timer.finish("write");
+    }
+    timer.total();
+
+    if (!options.profile.empty()) {
+        Profiler::writeJson(options.profile);
+    }
+    if (!options.trace.empty()) {
+        Profiler::writeTrace(options.trace);
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            std::fputs(usage, stdout);
+            return 0;
+        }
+        return run(options);
+    } catch (const UsageError& e) {
+        std::fprintf(stderr, "floorplanner_cli: %s\n\n%s", e.what(), usage);
+        return 2;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "floorplanner_cli: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Builds the core library, the GUI, the command line tools and the tests
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = core gui cli generate bench tests
+
+core.file = floorplanner_core.pro
+
+gui.file = floorplanner_gui.pro
+gui.depends = core
+
+cli.file = floorplanner_cli.pro
+cli.depends = core
+
+generate.file = floorplanner_generate.pro
+generate.depends = core
+
+bench.file = floorplanner_bench.pro
+bench.depends = core
+
+tests.file = floorplanner_tests.pro
+tests.depends = core
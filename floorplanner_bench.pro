@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Times the phases of the core library on generated floorplans
+#
+#-------------------------------------------------
+
+CONFIG -= qt app_bundle
+CONFIG += c++17 thread console
+
+TARGET = floorplanner_bench
+TEMPLATE = app
+OBJECTS_DIR = obj/bench
+
+include(floorplanner_core.pri)
+
+win32: LIBS += -lpsapi
+
+SOURCES += bench.cpp
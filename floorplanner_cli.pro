@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Runs the algorithms on designs without the GUI
+#
+#-------------------------------------------------
+
+CONFIG -= qt app_bundle
+CONFIG += c++17 thread console
+
+TARGET = floorplanner_cli
+TEMPLATE = app
+OBJECTS_DIR = obj/cli
+
+include(floorplanner_core.pri)
+
+SOURCES += cli.cpp
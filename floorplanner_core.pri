@@ -0,0 +1,14 @@
+# Links a project against the core library, see floorplanner_core.pro
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+integer_coordinates: DEFINES += FLOORPLANNER_INTEGER_COORDINATES
+
+LIBS += -L$$OUT_PWD -lfloorplanner_core
+
+win32-msvc* {
+    PRE_TARGETDEPS += $$OUT_PWD/floorplanner_core.lib
+} else {
+    PRE_TARGETDEPS += $$OUT_PWD/libfloorplanner_core.a
+}
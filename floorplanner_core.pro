@@ -0,0 +1,50 @@
+#-------------------------------------------------
+#
+# Slicing trees, the algorithms and the file formats, without Qt
+#
+#-------------------------------------------------
+
+CONFIG -= qt
+CONFIG += c++17 thread staticlib
+
+TARGET = floorplanner_core
+TEMPLATE = lib
+DESTDIR = $$OUT_PWD
+OBJECTS_DIR = obj/core
+
+# Integer rectangles in database units, see Geometry.h. Projects linking the
+# library get the same define from floorplanner_core.pri.
+integer_coordinates: DEFINES += FLOORPLANNER_INTEGER_COORDINATES
+
+SOURCES += \
+    Floorplans.cpp \
+    Geometry.cpp \
+    Module.cpp \
+    SlicingStructure.cpp \
+    InputOutputManager.cpp \
+    FloorplanArena.cpp \
+    SlicingTreeBuilder.cpp \
+    ThreadPool.cpp \
+    ParallelSlicingTreeBuilder.cpp \
+    Netlist.cpp \
+    MappedFile.cpp \
+    FloorplanGenerator.cpp \
+    Profiler.cpp \
+    Progress.cpp
+
+HEADERS += \
+    Floorplans.h \
+    Geometry.h \
+    Module.h \
+    SlicingStructure.h \
+    InputOutputManager.h \
+    FloorplanArena.h \
+    SlicingTreeBuilder.h \
+    ThreadPool.h \
+    ParallelSlicingTreeBuilder.h \
+    Netlist.h \
+    SwapEvaluation.h \
+    MappedFile.h \
+    FloorplanGenerator.h \
+    Profiler.h \
+    Progress.h
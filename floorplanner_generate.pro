@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Writes random slicing floorplans of any size
+#
+#-------------------------------------------------
+
+CONFIG -= qt app_bundle
+CONFIG += c++17 thread console
+
+TARGET = floorplanner_generate
+TEMPLATE = app
+OBJECTS_DIR = obj/generate
+
+include(floorplanner_core.pri)
+
+SOURCES += generator.cpp
@@ -8,26 +8,22 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
+CONFIG += c++17 thread
+
 TARGET = floorplanner_gui
 TEMPLATE = app
 
-INCLUDEPATH += C:\Boost\include\boost-1_63
+OBJECTS_DIR = obj/gui
+
+include(floorplanner_core.pri)
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    Floorplans.cpp \
-    Geometry.cpp \
-    Module.cpp \
-    SlicingStructure.cpp \
     GraphicsArea.cpp \
-    InputOutputManager.cpp
+    BackgroundJob.cpp
 
 HEADERS  += mainwindow.h \
-    Floorplans.h \
-    Geometry.h \
-    Module.h \
-    SlicingStructure.h \
     GraphicsArea.h \
-    InputOutputManager.h
+    BackgroundJob.h
 
 FORMS    += mainwindow.ui
@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Checks of the core library, run with make check
+#
+#-------------------------------------------------
+
+CONFIG -= qt app_bundle
+CONFIG += c++17 thread console testcase
+
+TARGET = floorplanner_tests
+TEMPLATE = app
+OBJECTS_DIR = obj/tests
+
+include(floorplanner_core.pri)
+
+SOURCES += tests.cpp
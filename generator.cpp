@@ -0,0 +1,122 @@
+#include "FloorplanGenerator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* usage =
+    "Usage: floorplanner_generate [options] <output>\n"
+    "\n"
+    "Writes a random slicing floorplan as a block file, which floorplanner_cli\n"
+    "and the GUI can read. The same options and seed give the same file.\n"
+    "\n"
+    "Options:\n"
+    "  --blocks N       number of blocks, 1000 by default\n"
+    "  --seed N         seed of the random generator, 1 by default\n"
+    "  --aspect R       largest aspect ratio of a region before it is cut across\n"
+    "                   its long side, 2 by default\n"
+    "  --skew S         0 splits blocks evenly at every cut, towards 1 cuts off\n"
+    "                   ever smaller parts, 0.2 by default\n"
+    "  --depth N        limit of the depth of cuts, 0 for none (default)\n"
+    "  --nets N         number of nets, 1 by default\n"
+    "  --net-size N     blocks of every net, 2 by default\n"
+    "  -h, --help       show this message\n";
+
+class UsageError
+    : public std::runtime_error
+{
+public:
+    UsageError(const std::string& message)
+        : std::runtime_error(message)
+    {
+    }
+};
+
+unsigned long parseCount(const std::string& option, const char* value)
+{
+    char* end = 0;
+    unsigned long result = std::strtoul(value, &end, 10);
+    if (end == value || *end != '\0') {
+        throw UsageError(option + " expects a number");
+    }
+    return result;
+}
+
+double parseReal(const std::string& option, const char* value)
+{
+    char* end = 0;
+    double result = std::strtod(value, &end);
+    if (end == value || *end != '\0') {
+        throw UsageError(option + " expects a number");
+    }
+    return result;
+}
+
+// Returns false if only the help was asked for
+bool parseOptions(int argc, char* argv[], GeneratorOptions& options, std::string& output)
+{
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--blocks" || arg == "--seed" || arg == "--aspect" || arg == "--skew"
+                   || arg == "--depth" || arg == "--nets" || arg == "--net-size") {
+            if (i + 1 == argc) {
+                throw UsageError(arg + " expects a value");
+            }
+            const char* value = argv[++i];
+            if (arg == "--blocks") {
+                options.blockCount = parseCount(arg, value);
+            } else if (arg == "--seed") {
+                options.seed = static_cast<unsigned>(parseCount(arg, value));
+            } else if (arg == "--aspect") {
+                options.maxAspectRatio = parseReal(arg, value);
+            } else if (arg == "--skew") {
+                options.skew = parseReal(arg, value);
+            } else if (arg == "--depth") {
+                options.maxDepth = parseCount(arg, value);
+            } else if (arg == "--nets") {
+                options.netCount = parseCount(arg, value);
+            } else {
+                options.netSize = parseCount(arg, value);
+            }
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw UsageError("unknown option " + arg);
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 1) {
+        throw UsageError("expected one output file");
+    }
+    output = files[0];
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    GeneratorOptions options;
+    std::string output;
+    try {
+        if (!parseOptions(argc, argv, options, output)) {
+            std::fputs(usage, stdout);
+            return 0;
+        }
+        generateFloorplan(output, options);
+        return 0;
+    } catch (const UsageError& e) {
+        std::fprintf(stderr, "floorplanner_generate: %s\n\n%s", e.what(), usage);
+        return 2;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "floorplanner_generate: %s\n", e.what());
+        return 1;
+    }
+}
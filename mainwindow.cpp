@@ -2,13 +2,57 @@
 #include "ui_mainwindow.h"
 
 #include "InputOutputManager.h"
+#include "Profiler.h"
 
 #include <QSplitter>
 #include <QFileDialog>
 #include <QString>
 #include <QMessageBox>
+#include <QProgressDialog>
+#include <QStatusBar>
+#include <QTimer>
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <exception>
+#include <memory>
+
+namespace {
+
+// Results of a job, handed over to the window once it has finished
+struct LoadedDesign
+{
+    LoadedDesign()
+        : structure(0)
+    {
+    }
+
+    std::pair<std::vector<Module*>, Netlist> design;
+    SlicingStructure* structure;
+};
+
+struct RunResult
+{
+    RunResult()
+        : structure(0)
+        , prepared(0)
+    {
+    }
+
+    SlicingStructure* structure;
+    SlicingStructure* prepared;     // the input made ready for the first run
+};
+
+void deleteModules(std::vector<Module*>& modules)
+{
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        delete modules[i];
+    }
+    modules.clear();
+}
+
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -19,7 +63,15 @@ MainWindow::MainWindow(QWidget *parent)
     , m_netMigrationAction(0)
     , m_reduceDistanceAction(0)
     , m_netContraction(0)
+    , m_balanceChainsAction(0)
+    , m_undoAction(0)
+    , m_redoAction(0)
+    , m_profileAction(0)
+    , m_saveProfileAction(0)
     , m_targetPoint(Point::undefined)
+    , m_job(0)
+    , m_progressDialog(0)
+    , m_progressTimer(0)
 {
     setWindowTitle("Floorplanner");
     resize(1000, 700);
@@ -29,11 +81,30 @@ MainWindow::MainWindow(QWidget *parent)
 
     m_inputView->setContextMenuPolicy(Qt::CustomContextMenu);
     QObject::connect(m_inputView, SIGNAL(customContextMenuRequested(const QPoint& )), this, SLOT(onContextMenuRequested(const QPoint& )));
+    QObject::connect(m_inputView, SIGNAL(moduleClicked(Module*)), this, SLOT(toggleNetModule(Module*)));
+    QObject::connect(m_outputView, SIGNAL(moduleClicked(Module*)), this, SLOT(toggleNetModule(Module*)));
+
+    m_progressDialog = new QProgressDialog(this);
+    m_progressDialog->setWindowModality(Qt::WindowModal);
+    m_progressDialog->setMinimumDuration(500);
+    m_progressDialog->setAutoClose(false);
+    m_progressDialog->setAutoReset(false);
+    m_progressDialog->reset();  // or Qt shows it after the minimum duration
+    connect(m_progressDialog, SIGNAL(canceled()), this, SLOT(cancelJob()));
+
+    m_progressTimer = new QTimer(this);
+    m_progressTimer->setInterval(100);
+    connect(m_progressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
 }
 
 MainWindow::~MainWindow()
 {
-
+    // The job may use the thread pool, so it has to end first
+    if (0 != m_job) {
+        m_job->progress().cancel();
+        m_job->wait();
+    }
+    closeDesign();
 }
 
 void MainWindow::onContextMenuRequested(const QPoint& pos)
@@ -57,6 +128,7 @@ void MainWindow::onContextMenuRequested(const QPoint& pos)
 void MainWindow::createMenus()
 {
     QMenu* fileMenu = new QMenu(tr("&File"), 0);
+    QMenu* editMenu = new QMenu(tr("&Edit"), 0);
     QMenu* runMenu = new QMenu(tr("&Run"), 0);
     QMenu* helpMenu = new QMenu(tr("&Help"), 0);
 
@@ -73,6 +145,25 @@ void MainWindow::createMenus()
     connect(closeAction, SIGNAL(triggered()), this, SLOT(closeDesign()));
     fileMenu->addAction(closeAction);
 
+    fileMenu->addSeparator();
+    m_saveProfileAction = new QAction(tr("Save &Profile..."), this);
+    connect(m_saveProfileAction, SIGNAL(triggered()), this, SLOT(saveProfile()));
+    fileMenu->addAction(m_saveProfileAction);
+    m_saveProfileAction->setEnabled(false);
+
+    // edit menu items
+    m_undoAction = new QAction(tr("&Undo"), this);
+    m_undoAction->setShortcut(QKeySequence::Undo);
+    connect(m_undoAction, SIGNAL(triggered()), this, SLOT(undo()));
+    editMenu->addAction(m_undoAction);
+    m_undoAction->setEnabled(false);
+
+    m_redoAction = new QAction(tr("&Redo"), this);
+    m_redoAction->setShortcut(QKeySequence::Redo);
+    connect(m_redoAction, SIGNAL(triggered()), this, SLOT(redo()));
+    editMenu->addAction(m_redoAction);
+    m_redoAction->setEnabled(false);
+
     // run menu items
     m_reduceDistanceAction = new QAction(tr("&Reduce Distance"), this);
     connect(m_reduceDistanceAction, SIGNAL(triggered()), this, SLOT(runReduceDistance()));
@@ -89,6 +180,18 @@ void MainWindow::createMenus()
     runMenu->addAction(m_netContraction);
     m_netContraction->setEnabled(false);
 
+    // Applies to the output floorplan created by the next run
+    runMenu->addSeparator();
+    m_balanceChainsAction = new QAction(tr("&Balance Cut Chains"), this);
+    m_balanceChainsAction->setCheckable(true);
+    runMenu->addAction(m_balanceChainsAction);
+
+    // Times the phases of every following action, see Profiler
+    m_profileAction = new QAction(tr("&Profile"), this);
+    m_profileAction->setCheckable(true);
+    connect(m_profileAction, SIGNAL(toggled(bool)), this, SLOT(setProfiling(bool)));
+    runMenu->addAction(m_profileAction);
+
     // help menu items
     QAction* helpAction = new QAction(tr("Help"), this);
     connect(helpAction, SIGNAL(triggered()), this, SLOT(showHelp()));
@@ -99,6 +202,7 @@ void MainWindow::createMenus()
     helpMenu->addAction(aboutAction);
 
     this->menuBar()->addMenu(fileMenu);
+    this->menuBar()->addMenu(editMenu);
     this->menuBar()->addMenu(runMenu);
     this->menuBar()->addMenu(helpMenu);
 }
@@ -117,91 +221,396 @@ void MainWindow::createViews()
 void MainWindow::openDesign()
 {
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open File..."));
-    if (fileName != "") {
-        std::pair<std::vector<Module*>, std::set<Module*> > moduleInfo = readBlocks(fileName.toStdString());
+    if (fileName == "") {
+        return;
+    }
+    const std::string name = fileName.toStdString();
+    ThreadPool* pool = &m_threadPool;
+    std::shared_ptr<LoadedDesign> loaded = std::make_shared<LoadedDesign>();
+    startJob(tr("Open Design"), [name, pool, loaded](Progress& progress) {
+        // Binary designs come with their slicing tree, text designs are built
+        if (isBinaryDesign(name)) {
+            loaded->structure = readBinaryDesign(name, loaded->design);
+            return;
+        }
+        loaded->design = readDesign(name, pool, &progress);
+        try {
+            loaded->structure = new SlicingStructure(loaded->design.first, *pool, &progress);
+        } catch (...) {
+            deleteModules(loaded->design.first);
+            throw;
+        }
+    }, [this, loaded](BackgroundJob& job) {
+        if (!job.succeeded()) {
+            return;
+        }
+        // Runs and undo states of the previous design refer to its modules
+        closeDesign();
+        const std::pair<std::vector<Module*>, Netlist>& design = loaded->design;
+        std::pair<std::vector<Module*>, std::set<Module*> > moduleInfo;
+        moduleInfo.first = design.first;
+        for (Netlist::Id net = 0; net < design.second.netCount(); ++net) {
+            for (const Netlist::Id* it = design.second.netModulesBegin(net); it != design.second.netModulesEnd(net); ++it) {
+                moduleInfo.second.insert(design.first[*it]);
+            }
+        }
         m_moduleInfo = moduleInfo;
-        m_slicingStrucure = new SlicingStructure(moduleInfo.first);
-        m_inputView->setFloorplan(m_slicingStrucure->floorplan());
+        m_netlist = design.second;
+        m_slicingStrucure = loaded->structure;
+        m_inputView->setFloorplan(m_slicingStrucure);
         m_inputView->setSelectedItems(moduleInfo.second);
         m_inputView->draw();
+        updateRunActions();
+    });
+}
 
-        if (moduleInfo.second.size() > 0) {
-            m_netMigrationAction->setEnabled(true);
-            m_netContraction->setEnabled(true);
-            if (moduleInfo.second.size() == 2) {
-                m_reduceDistanceAction->setEnabled(true);
-            } else {
-                m_reduceDistanceAction->setEnabled(false);
-            }
+void MainWindow::updateRunActions()
+{
+    if (m_moduleInfo.second.size() > 0) {
+        m_netMigrationAction->setEnabled(true);
+        m_netContraction->setEnabled(true);
+        if (m_moduleInfo.second.size() == 2) {
+            m_reduceDistanceAction->setEnabled(true);
         } else {
-            m_netMigrationAction->setEnabled(false);
-            m_netContraction->setEnabled(false);
             m_reduceDistanceAction->setEnabled(false);
         }
+    } else {
+        m_netMigrationAction->setEnabled(false);
+        m_netContraction->setEnabled(false);
+        m_reduceDistanceAction->setEnabled(false);
+    }
+}
+
+void MainWindow::toggleNetModule(Module* module)
+{
+    if (0 != m_job || 0 == m_slicingStrucure) {
+        return;
+    }
+    const QString name = QString::fromStdString(module->name);
+    if (m_netlist.netCount() > 1) {
+        statusBar()->showMessage(tr("%1: nets of designs with several nets are not edited by clicking").arg(name));
+        return;
+    }
+
+    std::set<Module*>& net = m_moduleInfo.second;
+    const bool added = (net.erase(module) == 0);
+    if (added) {
+        net.insert(module);
+    }
+    // The netlist is what binary designs save
+    std::vector<Netlist::Pin> pins;
+    std::set<Module*>::const_iterator it;
+    for (it = net.begin(); it != net.end(); ++it) {
+        pins.push_back(Netlist::Pin(static_cast<Netlist::Id>(m_slicingStrucure->moduleIndex(*it)), 0));
+    }
+    m_netlist = Netlist(m_moduleInfo.first.size(), pins);
+
+    m_inputView->setSelectedItems(net);
+    m_inputView->draw();
+    if (m_outputSlicingStructure != 0) {
+        m_outputView->setSelectedItems(net);
+        m_outputView->draw();
     }
+    updateRunActions();
+    statusBar()->showMessage((added ? tr("%1 added to the net, %2 blocks") : tr("%1 removed from the net, %2 blocks"))
+                             .arg(name).arg(net.size()));
 }
 
 void MainWindow::saveDesign()
 {
-    QString fileName = QFileDialog::getSaveFileName(this, tr("Open File..."));
-    if (fileName != "") {
-        writeFloorplan(fileName.toStdString(), m_outputSlicingStructure->floorplan(), m_moduleInfo.second);
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Open File..."), QString(),
+                                                    tr("Block files (*.txt);;Binary floorplans (*.sfp);;All files (*)"));
+    if (fileName == "") {
+        return;
+    }
+    // The input floorplan, if nothing was run yet
+    const SlicingStructure* structure = (m_outputSlicingStructure != 0) ? m_outputSlicingStructure : m_slicingStrucure;
+    if (structure == 0) {
+        return;
+    }
+    startProfile();
+    if (fileName.endsWith(".sfp", Qt::CaseInsensitive)) {
+        writeBinaryDesign(fileName.toStdString(), *structure, m_netlist, true);
+    } else {
+        writeFloorplan(fileName.toStdString(), *structure, m_netlist);
     }
+    finishProfile();
 }
 
 void MainWindow::closeDesign()
 {
+    clearUndoStates();
     delete m_outputSlicingStructure;
     m_outputSlicingStructure = 0;
 
     delete m_slicingStrucure;
     m_slicingStrucure = 0;
 
-    m_moduleInfo.first.clear();
+    // Structures do not own the modules
+    deleteModules(m_moduleInfo.first);
     m_moduleInfo.second.clear();
+    m_netlist = Netlist();
+    m_targetPoint = Point::undefined;
 
     m_inputView->reset();
     m_outputView->reset();
+    updateRunActions();
+}
+
+void MainWindow::pushUndoState(SlicingStructure* state)
+{
+    m_undoStates.push_back(state);
+    for (std::size_t i = 0; i < m_redoStates.size(); ++i) {
+        delete m_redoStates[i];
+    }
+    m_redoStates.clear();
+    updateUndoActions();
+}
+
+void MainWindow::clearUndoStates()
+{
+    for (std::size_t i = 0; i < m_undoStates.size(); ++i) {
+        delete m_undoStates[i];
+    }
+    m_undoStates.clear();
+    for (std::size_t i = 0; i < m_redoStates.size(); ++i) {
+        delete m_redoStates[i];
+    }
+    m_redoStates.clear();
+    updateUndoActions();
+}
+
+void MainWindow::showOutputStructure(SlicingStructure* structure)
+{
+    m_outputSlicingStructure = structure;
+    m_outputView->setFloorplan(m_outputSlicingStructure);
+    m_outputView->draw();
+    updateUndoActions();
+}
+
+void MainWindow::updateUndoActions()
+{
+    m_undoAction->setEnabled(!m_undoStates.empty());
+    m_redoAction->setEnabled(!m_redoStates.empty());
+}
+
+void MainWindow::undo()
+{
+    if (m_undoStates.empty() || 0 != m_job) {
+        return;
+    }
+    m_redoStates.push_back(m_outputSlicingStructure);
+    SlicingStructure* state = m_undoStates.back();
+    m_undoStates.pop_back();
+    showOutputStructure(state);
+}
+
+void MainWindow::redo()
+{
+    if (m_redoStates.empty() || 0 != m_job) {
+        return;
+    }
+    m_undoStates.push_back(m_outputSlicingStructure);
+    SlicingStructure* state = m_redoStates.back();
+    m_redoStates.pop_back();
+    showOutputStructure(state);
+}
+
+void MainWindow::startJob(const QString& title, const BackgroundJob::Work& work, const JobDone& done)
+{
+    assert(0 == m_job);
+    startProfile();
+    m_jobTitle = title;
+    m_jobDone = done;
+    m_job = new BackgroundJob(work, this);
+    connect(m_job, SIGNAL(finished()), this, SLOT(finishJob()));
+
+    menuBar()->setEnabled(false);
+    centralWidget()->setEnabled(false);
+    m_progressDialog->reset();
+    m_progressDialog->setWindowTitle(title);
+    m_progressDialog->setLabelText(title);
+    m_progressDialog->setRange(0, 1000);
+    m_progressDialog->setValue(0);
+    m_progressTimer->start();
+    m_job->start();
+}
+
+void MainWindow::finishJob()
+{
+    assert(0 != m_job);
+    BackgroundJob* job = m_job;
+    job->wait();
+    m_job = 0;
+    m_progressTimer->stop();
+    m_progressDialog->reset();
+    m_progressDialog->hide();
+    menuBar()->setEnabled(true);
+    centralWidget()->setEnabled(true);
+
+    JobDone done;
+    done.swap(m_jobDone);
+    done(*job);
+    if (job->wasCancelled()) {
+        statusBar()->showMessage(tr("%1 cancelled").arg(m_jobTitle));
+    } else if (!job->succeeded()) {
+        QMessageBox::warning(this, m_jobTitle, job->error());
+    }
+    delete job;
+    finishProfile();
+}
+
+void MainWindow::updateProgress()
+{
+    if (0 == m_job || m_progressDialog->wasCanceled()) {
+        return;
+    }
+    const Progress& progress = m_job->progress();
+    m_progressDialog->setLabelText(tr("%1...").arg(QString::fromLatin1(progress.phase())));
+    const std::uint64_t total = progress.total();
+    if (total == 0) {
+        m_progressDialog->setRange(0, 0);
+        return;
+    }
+    // Kept below the maximum, as done may exceed the estimated total
+    m_progressDialog->setRange(0, 1000);
+    m_progressDialog->setValue(static_cast<int>(std::min(progress.done(), total) * 999 / total));
+}
+
+void MainWindow::cancelJob()
+{
+    if (0 != m_job) {
+        m_job->progress().cancel();
+        statusBar()->showMessage(tr("Cancelling %1...").arg(m_jobTitle));
+    }
+}
+
+void MainWindow::runOnOutput(const QString& title, const Operation& operation, const std::function<void ()>& shown)
+{
+    // The views keep the current structures meanwhile; the snapshot shares
+    // their nodes and copies those the job changes
+    const bool first = (m_outputSlicingStructure == 0);
+    const bool balance = first && m_balanceChainsAction->isChecked();
+    ThreadPool* pool = &m_threadPool;
+    std::shared_ptr<RunResult> result = std::make_shared<RunResult>();
+    result->structure = new SlicingStructure(first ? *m_slicingStrucure : *m_outputSlicingStructure);
+    startJob(title, [result, first, balance, pool, operation](Progress& progress) {
+        SlicingStructure& structure = *result->structure;
+        if (first) {
+            if (balance) {
+                structure.balanceChains();
+            }
+            structure.compact();
+            result->prepared = new SlicingStructure(structure);
+        }
+        structure.setThreadPool(pool);
+        structure.setProgress(&progress);
+        operation(structure);
+        structure.setProgress(0);
+        structure.updateCoordinates();
+    }, [this, result, shown](BackgroundJob& job) {
+        if (!job.succeeded()) {
+            delete result->structure;
+            delete result->prepared;
+            return;
+        }
+        pushUndoState(result->prepared != 0 ? result->prepared : m_outputSlicingStructure);
+        showOutputStructure(result->structure);
+        m_outputView->setSelectedItems(m_moduleInfo.second);
+        if (shown) {
+            shown();
+        }
+    });
 }
 
 void MainWindow::runReduceDistance()
 {
     assert(!m_moduleInfo.first.empty() && m_moduleInfo.second.size() == 2);
-    if (m_outputSlicingStructure == 0) {
-        m_outputSlicingStructure = new SlicingStructure(m_moduleInfo.first);
-        m_outputView->setFloorplan(m_outputSlicingStructure->floorplan());
-        m_outputView->setSelectedItems(m_moduleInfo.second);
-    }
     std::set<Module*>::iterator it = m_moduleInfo.second.begin();
     Module* module1 = *it;
     Module* module2 = *(++it);
-    m_outputSlicingStructure->reduceDistnace(module1, module2);
-    m_outputView->draw();
+    runOnOutput(tr("Reduce Distance"), [module1, module2](SlicingStructure& structure) {
+        structure.reduceDistnace(module1, module2);
+    });
 }
 
 void MainWindow::runNetMigration()
 {
     assert(!m_moduleInfo.first.empty() && !m_moduleInfo.second.empty());
-    if (m_outputSlicingStructure == 0) {
-        m_outputSlicingStructure = new SlicingStructure(m_moduleInfo.first);
-        m_outputView->setFloorplan(m_outputSlicingStructure->floorplan());
-        m_outputView->setSelectedItems(m_moduleInfo.second);
-    }
-    m_outputSlicingStructure->applyNetMigration(m_moduleInfo.second, m_targetPoint);
-    m_outputView->setTargetPoint(m_targetPoint);
-    m_outputView->draw();
+    // Neither changes while the job runs, as the menus are disabled
+    const Netlist* netlist = &m_netlist;
+    const std::set<Module*>* netModules = &m_moduleInfo.second;
+    const Point target = m_targetPoint;
+    runOnOutput(tr("Net Migration"), [netlist, netModules, target](SlicingStructure& structure) {
+        if (netlist->netCount() > 1) {
+            structure.applyNetMigration(*netlist, target);
+        } else {
+            structure.applyNetMigration(*netModules, target);
+        }
+    }, [this, target] {
+        m_outputView->setTargetPoint(target);
+        m_outputView->draw();
+    });
 }
 
 void MainWindow::runNetContraction()
 {
     assert(!m_moduleInfo.first.empty() && !m_moduleInfo.second.empty());
-    if (m_outputSlicingStructure == 0) {
-        m_outputSlicingStructure = new SlicingStructure(m_moduleInfo.first);
-        m_outputView->setFloorplan(m_outputSlicingStructure->floorplan());
-        m_outputView->setSelectedItems(m_moduleInfo.second);
+    const Netlist* netlist = &m_netlist;
+    const std::set<Module*>* netModules = &m_moduleInfo.second;
+    runOnOutput(tr("Net Contraction"), [netlist, netModules](SlicingStructure& structure) {
+        if (netlist->netCount() > 1) {
+            structure.applyNetContraction(*netlist);
+        } else {
+            structure.applyNetContraction(*netModules);
+        }
+    });
+}
+
+void MainWindow::startProfile()
+{
+    if (Profiler::isEnabled()) {
+        Profiler::reset();
+    }
+}
+
+void MainWindow::finishProfile()
+{
+    // Runs after the paint events posted by the views
+    if (Profiler::isEnabled()) {
+        QTimer::singleShot(0, this, SLOT(showProfile()));
+    }
+}
+
+void MainWindow::showProfile()
+{
+    statusBar()->showMessage(QString::fromStdString(Profiler::summary()));
+}
+
+void MainWindow::setProfiling(bool enabled)
+{
+    Profiler::setEnabled(enabled);
+    m_saveProfileAction->setEnabled(enabled);
+    statusBar()->clearMessage();
+}
+
+void MainWindow::saveProfile()
+{
+    QString selectedFilter;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Profile..."), QString(),
+                                                    tr("Profiles (*.json);;Chrome traces (*.json)"), &selectedFilter);
+    if (fileName == "") {
+        return;
+    }
+    try {
+        if (selectedFilter.startsWith("Chrome")) {
+            Profiler::writeTrace(fileName.toStdString());
+        } else {
+            Profiler::writeJson(fileName.toStdString());
+        }
+    } catch (const std::exception& e) {
+        QMessageBox::warning(this, "Save Profile", e.what());
     }
-    m_outputSlicingStructure->applyNetContraction(m_moduleInfo.second);
-    m_outputView->draw();
 }
 
 void MainWindow::showHelp()
@@ -3,10 +3,17 @@
 
 #include <QMainWindow>
 
+#include <functional>
 #include <set>
+#include <vector>
 
 #include "SlicingStructure.h"
 #include "GraphicsArea.h"
+#include "BackgroundJob.h"
+#include "ThreadPool.h"
+
+class QProgressDialog;
+class QTimer;
 
 namespace Ui {
 class MainWindow;
@@ -21,9 +28,35 @@ public:
     ~MainWindow();
 
 private:
+    typedef std::function<void (BackgroundJob& )> JobDone;
+    typedef std::function<void (SlicingStructure& )> Operation;
+
     void createMenus();
     void createViews();
 
+    // Loading and the runs are jobs on a thread of their own, one at a time,
+    // with a progress dialog which cancels them. Menus and views take no
+    // input meanwhile. done is called on the GUI thread whatever the outcome,
+    // so it also frees the results of failed jobs.
+    void startJob(const QString& title, const BackgroundJob::Work& work, const JobDone& done);
+
+    // Applies the operation to a snapshot of the output structure, or of the
+    // input one before the first run, which becomes the output once done
+    void runOnOutput(const QString& title, const Operation& operation, const std::function<void ()>& shown = std::function<void ()>());
+
+    // Undo states are snapshots of the output structure, which share nodes
+    // with it until either of them changes
+    void pushUndoState(SlicingStructure* state);
+    void updateRunActions();    // after the net changed
+    void clearUndoStates();
+    void showOutputStructure(SlicingStructure* structure);
+    void updateUndoActions();
+
+    // With profiling on, every action starts a new profile, which is shown
+    // in the status bar once the views are painted
+    void startProfile();
+    void finishProfile();
+
 private slots:
     void openDesign();
     void saveDesign();
@@ -31,20 +64,46 @@ private slots:
     void runReduceDistance();
     void runNetMigration();
     void runNetContraction();
+    void undo();
+    void redo();
+    void finishJob();
+    void updateProgress();
+    void cancelJob();
+    void setProfiling(bool enabled);
+    void saveProfile();
+    void showProfile();
     void showHelp();
     void showAbout();
     void onContextMenuRequested(const QPoint& );
 
+    // Clicking a block adds it to the net or removes it, as long as the
+    // design has a single net
+    void toggleNetModule(Module* module);
+
 private:
     SlicingStructure* m_slicingStrucure;
     SlicingStructure* m_outputSlicingStructure;
     std::pair<std::vector<Module*>, std::set<Module*> > m_moduleInfo;
+    Netlist m_netlist;
     GraphicsArea* m_inputView;
     GraphicsArea* m_outputView;
     QAction* m_netMigrationAction;
     QAction* m_reduceDistanceAction;
     QAction* m_netContraction;
+    QAction* m_balanceChainsAction;
+    QAction* m_undoAction;
+    QAction* m_redoAction;
+    QAction* m_profileAction;
+    QAction* m_saveProfileAction;
+    std::vector<SlicingStructure*> m_undoStates;
+    std::vector<SlicingStructure*> m_redoStates;
     Point m_targetPoint;
+    ThreadPool m_threadPool;
+    BackgroundJob* m_job;
+    JobDone m_jobDone;
+    QString m_jobTitle;
+    QProgressDialog* m_progressDialog;
+    QTimer* m_progressTimer;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,102 @@
+#include "InputOutputManager.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Checks of the core library. Prints the failed checks and returns 1 if
+// there were any.
+
+namespace {
+
+const char* const fileName = "floorplanner_tests.txt";
+
+int failures = 0;
+
+void check(bool condition, const std::string& what)
+{
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+bool contains(const std::string& text, const std::string& part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+void deleteModules(std::vector<Module*>& modules)
+{
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        delete modules[i];
+    }
+    modules.clear();
+}
+
+// Reads the text as a block file, returns the error or "" if it was read
+std::string readText(const std::string& text, std::pair<std::vector<Module*>, Netlist>& design)
+{
+    {
+        std::ofstream outFile(fileName);
+        outFile << text;
+    }
+    try {
+        design = readDesign(fileName);
+    } catch (const std::runtime_error& e) {
+        std::remove(fileName);
+        return e.what();
+    }
+    std::remove(fileName);
+    return "";
+}
+
+std::string readError(const std::string& text)
+{
+    std::pair<std::vector<Module*>, Netlist> design;
+    const std::string error = readText(text, design);
+    deleteModules(design.first);
+    return error;
+}
+
+void testParser()
+{
+    std::pair<std::vector<Module*>, Netlist> design;
+    check(readText("1 2 3 4\n", design).empty(), "a block without nets is read");
+    check(design.first.size() == 1 && design.second.netCount() == 0, "a block without nets has no nets");
+    if (design.first.size() == 1) {
+        const Rectangle& rect = design.first[0]->rect;
+        check(rect.x() == 1 && rect.y() == 2 && rect.width() == 3 && rect.height() == 4, "coordinates are read in order");
+    }
+    deleteModules(design.first);
+
+    check(readText("0 0 1 1 +\n1 0 1 1 7\n", design).empty(), "net ids and + are read");
+    check(design.second.netCount() == 2 && design.second.netId(0) == 0 && design.second.netId(1) == 7,
+          "+ is net 0 and ids are kept");
+    deleteModules(design.first);
+
+    check(readError(".5 1. 2 3\n").empty(), "digits on one side of the point are enough");
+
+    // An empty field must not shift the height into the nets
+    check(contains(readError("0 0 1 1\n1  2 3 4\n"), "line 2"), "an empty field is reported with its line");
+    check(contains(readError("1 2 3\n"), "line 1"), "three fields are reported with their line");
+    check(contains(readError("1 2 3 \n"), "line 1"), "a trailing space is not a field");
+    check(contains(readError("1 2 . 4\n"), "line 1"), "a point without digits is not a number");
+    check(contains(readError("0 0 1 1 4294967296\n"), "net id out of range"), "net ids above 32 bits are reported");
+}
+
+}
+
+int main()
+{
+    testParser();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}